@@ -0,0 +1,111 @@
+#include "encoding.h"
+#include "thread_pool.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <thread>
+
+namespace
+{
+
+const tiktoken::GptEncoding &encoder()
+{
+    static const auto encoding = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    return encoding;
+}
+
+// Many short documents of varied length, the case batching is for.
+const tiktoken::tt_stl::vector<tiktoken::tt_stl::string> &documents()
+{
+    static const auto result = [] {
+        const tiktoken::tt_stl::string paragraph =
+            "The quick brown fox jumps over the lazy dog. It's 2024, and we've got 1234567 reasons\n"
+            "to tokenize    text quickly: JSON {\"key\": [1, 2, 3]}, code like foo(bar) && baz;\n\n"
+            "Ünïcödé wörds, 你好世界, and emoji 🎉 show up too.   \n";
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<size_t> length(20, 2000);
+        tiktoken::tt_stl::vector<tiktoken::tt_stl::string> docs;
+        for (int i = 0; i < 10000; ++i) {
+            tiktoken::tt_stl::string doc;
+            const size_t size = length(rng);
+            while (doc.size() < size) {
+                doc += paragraph.substr(rng() % 64);
+            }
+            docs.push_back(std::move(doc));
+        }
+        return docs;
+    }();
+    return result;
+}
+
+size_t total_bytes()
+{
+    size_t bytes = 0;
+    for (const auto &doc: documents()) {
+        bytes += doc.size();
+    }
+    return bytes;
+}
+
+void BM_EncodeLoop(benchmark::State &state)
+{
+    for (auto _: state) {
+        for (const auto &doc: documents()) {
+            benchmark::DoNotOptimize(encoder().encode(doc));
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * total_bytes()));
+}
+
+void BM_EncodeBatch(benchmark::State &state)
+{
+    tiktoken::ThreadPool pool(static_cast<size_t>(state.range(0)));
+    const tiktoken::tt_stl::vector<std::string_view> texts(documents().begin(), documents().end());
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder().encode_batch(texts, {}, tiktoken::GptEncoding::all_special_tokens(), &pool));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * total_bytes()));
+}
+
+void BM_DecodeBatch(benchmark::State &state)
+{
+    tiktoken::ThreadPool pool(static_cast<size_t>(state.range(0)));
+    const tiktoken::tt_stl::vector<std::string_view> texts(documents().begin(), documents().end());
+    const auto batch = encoder().encode_batch(texts, {}, tiktoken::GptEncoding::all_special_tokens(), &pool);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder().decode_batch(batch, &pool));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * total_bytes()));
+}
+
+// The same documents as one text, cut up inside encode_parallel instead of by the caller.
+void BM_EncodeParallel(benchmark::State &state)
+{
+    tiktoken::ThreadPool pool(static_cast<size_t>(state.range(0)));
+    tiktoken::tt_stl::string text;
+    for (const auto &doc: documents()) {
+        text += doc;
+    }
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder().encode_parallel(text, {}, tiktoken::GptEncoding::all_special_tokens(), &pool));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+// 1, 2, 4, ... threads up to the hardware thread count.
+void thread_counts(benchmark::internal::Benchmark *benchmark)
+{
+    const int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int threads = 1; threads < hardware; threads *= 2) {
+        benchmark->Arg(threads);
+    }
+    benchmark->Arg(hardware);
+}
+
+}
+
+BENCHMARK(BM_EncodeLoop)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_EncodeBatch)->Apply(thread_counts)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_EncodeParallel)->Apply(thread_counts)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_DecodeBatch)->Apply(thread_counts)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,35 @@
+#include "encoding.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+namespace
+{
+
+// A single run of letters is one pre-tokenizer piece, so the whole input goes through one byte_pair_merge call.
+tiktoken::tt_stl::string make_letter_piece(size_t length)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    tiktoken::tt_stl::string piece(length, ' ');
+    for (auto &c: piece) {
+        c = static_cast<char>(letter(rng));
+    }
+    return piece;
+}
+
+void BM_EncodeSinglePiece(benchmark::State &state)
+{
+    static auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const auto piece = make_letter_piece(static_cast<size_t>(state.range(0)));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder.encode(piece));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    state.SetComplexityN(state.range(0));
+}
+
+}
+
+BENCHMARK(BM_EncodeSinglePiece)->RangeMultiplier(4)->Range(16, 1 << 16)->Complexity();
@@ -0,0 +1,98 @@
+#include "encoding.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+
+const tiktoken::GptEncoding &encoder()
+{
+    static const auto encoding = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    return encoding;
+}
+
+// Budgeting calls are mostly short prompts, so the per-call cost matters as much as the per-byte cost.
+tiktoken::tt_stl::string make_text(size_t size)
+{
+    const tiktoken::tt_stl::string paragraph =
+        "The quick brown fox jumps over the lazy dog. It's 2024, and we've got 1234567 reasons\n"
+        "to tokenize    text quickly: JSON {\"key\": [1, 2, 3]}, code like foo(bar) && baz;\n\n"
+        "Ünïcödé wörds, 你好世界, and emoji 🎉 show up too.   \n";
+    tiktoken::tt_stl::string text;
+    while (text.size() < size) {
+        text += paragraph;
+    }
+    text.resize(size);
+    return text;
+}
+
+void BM_EncodeSize(benchmark::State &state)
+{
+    const auto text = make_text(static_cast<size_t>(state.range(0)));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder().encode(text).size());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_CountTokens(benchmark::State &state)
+{
+    const auto text = make_text(static_cast<size_t>(state.range(0)));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder().count_tokens(text));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+// Token byte ranges the old way, an encode and then a decode of every token, against encode_with_offsets.
+void BM_EncodeDecodeEach(benchmark::State &state)
+{
+    const auto text = make_text(static_cast<size_t>(state.range(0)));
+    for (auto _: state) {
+        const auto tokens = encoder().encode(text);
+        size_t start = 0;
+        for (const int token: tokens) {
+            start += encoder().decode({ token }).size();
+        }
+        benchmark::DoNotOptimize(start);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_EncodeWithOffsets(benchmark::State &state)
+{
+    const auto text = make_text(static_cast<size_t>(state.range(0)));
+    tiktoken::tt_stl::vector<int> tokens;
+    tiktoken::tt_stl::vector<tiktoken::ByteRange> offsets;
+    for (auto _: state) {
+        encoder().encode_with_offsets(text, tokens, offsets);
+        benchmark::DoNotOptimize(offsets.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+// The first range(0) tokens of a 2 MB text, which should cost about the same as encoding a text that short.
+void BM_EncodePrefix(benchmark::State &state)
+{
+    static const auto text = make_text(2 * 1024 * 1024);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder().encode_prefix(text, static_cast<size_t>(state.range(0))).offset);
+    }
+}
+
+void BM_FitsWithin(benchmark::State &state)
+{
+    static const auto text = make_text(2 * 1024 * 1024);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder().fits_within(text, static_cast<size_t>(state.range(0))));
+    }
+}
+
+}
+
+BENCHMARK(BM_EncodeSize)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK(BM_CountTokens)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK(BM_EncodePrefix)->RangeMultiplier(16)->Range(16, 1 << 16);
+BENCHMARK(BM_FitsWithin)->RangeMultiplier(16)->Range(16, 1 << 16);
+BENCHMARK(BM_EncodeDecodeEach)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK(BM_EncodeWithOffsets)->RangeMultiplier(16)->Range(64, 1 << 20);
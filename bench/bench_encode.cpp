@@ -0,0 +1,85 @@
+#include "corpora.h"
+#include "encoding.h"
+#include "encoding_registry.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+
+const tiktoken::GptEncoding &encoder(tiktoken::LanguageModel model)
+{
+    return *tiktoken::EncodingRegistry::get(model);
+}
+
+// Throughput both ways: bytes_per_second from the text and tokens_per_second from the tokens.
+void set_throughput(benchmark::State &state, size_t bytes, size_t tokens)
+{
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.counters["tokens_per_second"] = benchmark::Counter(static_cast<double>(state.iterations() * tokens),
+        benchmark::Counter::kIsRate);
+    state.counters["bytes_per_token"] = tokens == 0 ? 0.0 : static_cast<double>(bytes) / static_cast<double>(tokens);
+}
+
+void BM_Encode(benchmark::State &state, tiktoken::LanguageModel model, bench::Corpus corpus)
+{
+    const auto &encoding = encoder(model);
+    const auto &text = bench::corpus(corpus);
+    size_t tokens = 0;
+    for (auto _: state) {
+        const auto encoded = encoding.encode(text);
+        tokens = encoded.size();
+        benchmark::DoNotOptimize(encoded.data());
+    }
+    set_throughput(state, text.size(), tokens);
+}
+
+void BM_Decode(benchmark::State &state, tiktoken::LanguageModel model, bench::Corpus corpus)
+{
+    const auto &encoding = encoder(model);
+    const auto &text = bench::corpus(corpus);
+    const auto tokens = encoding.encode(text);
+    for (auto _: state) {
+        const auto decoded = encoding.decode(tokens);
+        benchmark::DoNotOptimize(decoded.data());
+    }
+    set_throughput(state, text.size(), tokens.size());
+}
+
+// Inputs that stress one stage, encoded with a policy that accepts them all.
+void BM_EncodeWorstCase(benchmark::State &state, tiktoken::LanguageModel model, bench::WorstCase worst_case)
+{
+    const auto &encoding = encoder(model);
+    const auto &text = bench::worst_case(worst_case);
+    size_t tokens = 0;
+    for (auto _: state) {
+        const auto encoded = encoding.encode(text, {}, {});
+        tokens = encoded.size();
+        benchmark::DoNotOptimize(encoded.data());
+    }
+    set_throughput(state, text.size(), tokens);
+}
+
+// Every model against every corpus, named like BM_Encode/cl100k_base/code so results line up between runs.
+const bool registered = [] {
+    for (size_t m = 0; m < static_cast<size_t>(tiktoken::LanguageModel::COUNT); ++m) {
+        const auto model = static_cast<tiktoken::LanguageModel>(m);
+        const tiktoken::tt_stl::string model_suffix = tiktoken::tt_stl::string("/") + bench::model_name(model) + "/";
+        for (size_t c = 0; c < static_cast<size_t>(bench::Corpus::COUNT); ++c) {
+            const auto corpus = static_cast<bench::Corpus>(c);
+            benchmark::RegisterBenchmark(("BM_Encode" + model_suffix + bench::corpus_name(corpus)).c_str(), BM_Encode,
+                model, corpus)->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark(("BM_Decode" + model_suffix + bench::corpus_name(corpus)).c_str(), BM_Decode,
+                model, corpus)->Unit(benchmark::kMillisecond);
+        }
+        for (size_t w = 0; w < static_cast<size_t>(bench::WorstCase::COUNT); ++w) {
+            const auto worst_case = static_cast<bench::WorstCase>(w);
+            benchmark::RegisterBenchmark(
+                ("BM_EncodeWorstCase" + model_suffix + bench::worst_case_name(worst_case)).c_str(), BM_EncodeWorstCase,
+                model, worst_case)->Unit(benchmark::kMillisecond);
+        }
+    }
+    return true;
+}();
+
+}
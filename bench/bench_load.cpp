@@ -0,0 +1,88 @@
+#include "corpora.h"
+#include "embedded_resource_reader.h"
+#include "encoding.h"
+#include "encoding_registry.h"
+#include "encoding_utils.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+
+// A cold get_encoding: reading and parsing the vocabulary file and building the tables encode needs.
+void BM_LoadEncoding(benchmark::State &state, tiktoken::LanguageModel model)
+{
+    for (auto _: state) {
+        auto encoding = tiktoken::GptEncoding::get_encoding(model);
+        benchmark::DoNotOptimize(encoding.max_token_value());
+    }
+    state.counters["tokens"] = static_cast<double>(tiktoken::GptEncoding::get_encoding(model).max_token_value() + 1);
+}
+
+// Only the vocabulary file: reading it, decoding its base64 and building the rank index.
+void BM_LoadRankTable(benchmark::State &state, const char *resource_name)
+{
+    size_t bytes = 0;
+    for (auto _: state) {
+        const auto ranks = tiktoken::EmbeddedResourceLoader(resource_name).loadRankTable();
+        bytes = ranks.byte_size();
+        benchmark::DoNotOptimize(ranks.slots());
+    }
+    state.counters["token_bytes"] = static_cast<double>(bytes);
+}
+
+tiktoken::tt_stl::string base64_encode(std::span<const uint8_t> bytes)
+{
+    static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    tiktoken::tt_stl::string encoded;
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        const size_t count = std::min<size_t>(3, bytes.size() - i);
+        uint32_t group = 0;
+        for (size_t j = 0; j < 3; ++j) {
+            group = group << 8 | (j < count ? bytes[i + j] : 0);
+        }
+        for (size_t j = 0; j < 4; ++j) {
+            encoded.push_back(j <= count ? alphabet[(group >> (18 - 6 * j)) & 0x3F] : '=');
+        }
+    }
+    return encoded;
+}
+
+// Decoding the base64 of every o200k_base token, the first column of its vocabulary file.
+void BM_Base64Decode(benchmark::State &state)
+{
+    const auto &ranks = tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::O200K_BASE)->get_byte_pair_token_map();
+    tiktoken::tt_stl::vector<tiktoken::tt_stl::string> encoded;
+    size_t input_bytes = 0;
+    for (const auto &byte_pair: ranks) {
+        encoded.push_back(base64_encode(byte_pair.first));
+        input_bytes += encoded.back().size();
+    }
+    tiktoken::tt_stl::vector<uint8_t> output;
+    for (auto _: state) {
+        size_t decoded = 0;
+        for (const auto &text: encoded) {
+            output.resize(tiktoken::base64::decoded_size_bound(text.size()));
+            decoded += tiktoken::base64::decode_into(text, output.data());
+        }
+        benchmark::DoNotOptimize(decoded);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input_bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * encoded.size()));
+}
+
+const bool registered = [] {
+    for (size_t m = 0; m < static_cast<size_t>(tiktoken::LanguageModel::COUNT); ++m) {
+        const auto model = static_cast<tiktoken::LanguageModel>(m);
+        benchmark::RegisterBenchmark((tiktoken::tt_stl::string("BM_LoadEncoding/") + bench::model_name(model)).c_str(),
+            BM_LoadEncoding, model)->Unit(benchmark::kMillisecond);
+    }
+    for (const char *resource_name: { "o200k_base.tiktoken", "cl100k_base.tiktoken" }) {
+        benchmark::RegisterBenchmark((tiktoken::tt_stl::string("BM_LoadRankTable/") + resource_name).c_str(),
+            BM_LoadRankTable, resource_name)->Unit(benchmark::kMillisecond);
+    }
+    benchmark::RegisterBenchmark("BM_Base64Decode/o200k_base", BM_Base64Decode)->Unit(benchmark::kMillisecond);
+    return true;
+}();
+
+}
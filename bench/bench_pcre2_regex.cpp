@@ -0,0 +1,64 @@
+#include "modelparams.h"
+#include "pcre2_regex.h"
+#include "pretokenizer.h"
+
+#include <benchmark/benchmark.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+
+namespace
+{
+
+tiktoken::tt_stl::string make_text()
+{
+    const tiktoken::tt_stl::string paragraph =
+        "The quick brown fox jumps over the lazy dog. It's 2024, and we've got 1234567 reasons\n"
+        "to tokenize    text quickly: JSON {\"key\": [1, 2, 3]}, code like foo(bar) && baz;\n\n"
+        "Ünïcödé wörds, 你好世界, and emoji 🎉 show up too.   \n";
+    tiktoken::tt_stl::string text;
+    while (text.size() < (1 << 20)) {
+        text += paragraph;
+    }
+    return text;
+}
+
+void BM_PreTokenize(benchmark::State &state, tiktoken::LanguageModel model, bool use_jit)
+{
+    static const auto text = make_text();
+    tiktoken::PCRERegex regex(tiktoken::ModelParamsGenerator::get_pattern(model), PCRE2_CASELESS, use_jit);
+    if (use_jit && !regex.is_jit_compiled()) {
+        state.SkipWithError("PCRE2 was built without JIT support");
+        return;
+    }
+    size_t pieces = 0;
+    for (auto _: state) {
+        regex.for_each_match(text, [&pieces](size_t, size_t) { ++pieces; });
+    }
+    benchmark::DoNotOptimize(pieces);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+void BM_PreTokenizeHandWritten(benchmark::State &state, tiktoken::LanguageModel model)
+{
+    static const auto text = make_text();
+    const auto pattern = tiktoken::find_pre_tokenizer_pattern(tiktoken::ModelParamsGenerator::get_pattern(model));
+    size_t pieces = 0;
+    for (auto _: state) {
+        tiktoken::for_each_pre_token(pattern, text, [&pieces](size_t, size_t) { ++pieces; });
+    }
+    benchmark::DoNotOptimize(pieces);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+}
+
+BENCHMARK_CAPTURE(BM_PreTokenize, o200k_interpreted, tiktoken::LanguageModel::O200K_BASE, false);
+BENCHMARK_CAPTURE(BM_PreTokenize, o200k_jit, tiktoken::LanguageModel::O200K_BASE, true);
+BENCHMARK_CAPTURE(BM_PreTokenizeHandWritten, o200k, tiktoken::LanguageModel::O200K_BASE);
+BENCHMARK_CAPTURE(BM_PreTokenize, cl100k_interpreted, tiktoken::LanguageModel::CL100K_BASE, false);
+BENCHMARK_CAPTURE(BM_PreTokenize, cl100k_jit, tiktoken::LanguageModel::CL100K_BASE, true);
+BENCHMARK_CAPTURE(BM_PreTokenizeHandWritten, cl100k, tiktoken::LanguageModel::CL100K_BASE);
+BENCHMARK_CAPTURE(BM_PreTokenize, p50k_interpreted, tiktoken::LanguageModel::P50K_BASE, false);
+BENCHMARK_CAPTURE(BM_PreTokenize, p50k_jit, tiktoken::LanguageModel::P50K_BASE, true);
+BENCHMARK_CAPTURE(BM_PreTokenizeHandWritten, p50k, tiktoken::LanguageModel::P50K_BASE);
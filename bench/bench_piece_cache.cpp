@@ -0,0 +1,27 @@
+#include "corpora.h"
+#include "encoding.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+
+void BM_EncodeEnglish(benchmark::State &state)
+{
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    encoder.set_piece_cache_capacity(static_cast<size_t>(state.range(0)));
+    const auto &text = bench::corpus(bench::Corpus::English);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(encoder.encode(text));
+    }
+    const auto stats = encoder.piece_cache_stats();
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    state.counters["hit_rate"] = stats.hits + stats.misses == 0
+        ? 0.0
+        : static_cast<double>(stats.hits) / static_cast<double>(stats.hits + stats.misses);
+}
+
+}
+
+// Capacity 0 is the cache switched off.
+BENCHMARK(BM_EncodeEnglish)->Arg(0)->Arg(1 << 10)->Arg(1 << 12)->Arg(1 << 14)->Arg(1 << 16)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,82 @@
+#include "encoding.h"
+#include "pretokenizer.h"
+#include "rank_table.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+
+const tiktoken::GptEncoding &encoder()
+{
+    static const auto encoding = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    return encoding;
+}
+
+// What byte_pair_merge asks for: every pre-tokenizer piece of some mixed text, and the short runs inside it. Most
+// pieces and runs have a rank, the rest do not.
+const tiktoken::tt_stl::vector<tiktoken::tt_stl::vector<uint8_t>> &lookup_keys()
+{
+    static const auto keys = [] {
+        const tiktoken::tt_stl::string text =
+            "The quick brown fox jumps over the lazy dog. It's 2024, and we've got 1234567 reasons\n"
+            "to tokenize    text quickly: JSON {\"key\": [1, 2, 3]}, code like foo(bar) && baz;\n\n"
+            "Ünïcödé wörds, 你好世界, and emoji 🎉 show up too. Antidisestablishmentarianism!\n";
+        const auto pattern = tiktoken::find_pre_tokenizer_pattern(
+            tiktoken::ModelParamsGenerator::get_pattern(tiktoken::LanguageModel::O200K_BASE));
+        tiktoken::tt_stl::vector<tiktoken::tt_stl::vector<uint8_t>> result;
+        tiktoken::for_each_pre_token(pattern, text, [&](size_t offset, size_t length) {
+            const auto *piece = reinterpret_cast<const uint8_t *>(text.data()) + offset;
+            result.emplace_back(piece, piece + length);
+            for (size_t width = 2; width <= 4; ++width) {
+                for (size_t start = 0; start + width <= length; ++start) {
+                    result.emplace_back(piece + start, piece + start + width);
+                }
+            }
+        });
+        return result;
+    }();
+    return keys;
+}
+
+void BM_RankLookupMap(benchmark::State &state)
+{
+    const auto &ranks = encoder().get_byte_pair_token_map();
+    const auto &keys = lookup_keys();
+    size_t found = 0;
+    for (auto _: state) {
+        for (const auto &key: keys) {
+            found += ranks.find(key) != ranks.end();
+        }
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * keys.size()));
+
+    // Each node holds the key vector, the rank and the cached hash; the key bytes are a second allocation.
+    size_t bytes = ranks.bucket_count() * sizeof(void *);
+    for (const auto &byte_pair: ranks) {
+        bytes += sizeof(void *) + sizeof(byte_pair) + sizeof(size_t) + byte_pair.first.capacity();
+    }
+    state.counters["memory_bytes"] = static_cast<double>(bytes);
+}
+
+void BM_RankLookupTable(benchmark::State &state)
+{
+    const tiktoken::RankTable ranks(encoder().get_byte_pair_token_map());
+    const auto &keys = lookup_keys();
+    size_t found = 0;
+    for (auto _: state) {
+        for (const auto &key: keys) {
+            found += ranks.find(key) >= 0;
+        }
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * keys.size()));
+    state.counters["memory_bytes"] = static_cast<double>((ranks.token_count() + 1) * sizeof(uint32_t)
+        + ranks.slot_count() * sizeof(tiktoken::RankTable::Slot) + ranks.byte_size());
+}
+
+}
+
+BENCHMARK(BM_RankLookupMap);
+BENCHMARK(BM_RankLookupTable);
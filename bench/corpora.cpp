@@ -0,0 +1,332 @@
+#include "corpora.h"
+
+#include <array>
+#include <cctype>
+#include <random>
+
+namespace bench
+{
+
+namespace
+{
+
+void append_code_point(tiktoken::tt_stl::string &text, uint32_t code_point)
+{
+    if (code_point < 0x80) {
+        text += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        text += static_cast<char>(0xC0 | (code_point >> 6));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        text += static_cast<char>(0xE0 | (code_point >> 12));
+        text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        text += static_cast<char>(0xF0 | (code_point >> 18));
+        text += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+// Draws indexes 0 to count - 1 with Zipf's law, index 0 the commonest.
+std::discrete_distribution<size_t> zipf(size_t count)
+{
+    tiktoken::tt_stl::vector<double> weights;
+    for (size_t rank = 1; rank <= count; ++rank) {
+        weights.push_back(1.0 / static_cast<double>(rank));
+    }
+    return std::discrete_distribution<size_t>(weights.begin(), weights.end());
+}
+
+// Words drawn with Zipf's law from a vocabulary that starts with the commonest English words and goes on with rarer
+// made-up ones, which like real rare words take several tokens each. The made-up words are damped to about a fifth of
+// all words, roughly the share of words that take more than one token in English prose.
+tiktoken::tt_stl::string make_english()
+{
+    tiktoken::tt_stl::vector<tiktoken::tt_stl::string> vocabulary = { "the", "of", "and", "to", "a", "in", "is",
+        "it", "you", "that", "he", "was", "for", "on", "are", "with", "as", "I", "his", "they", "be", "at", "one",
+        "have", "this", "from", "or", "had", "by", "not", "word", "but", "what", "some", "we", "can", "out",
+        "other", "were", "all", "there", "when", "up", "use", "your", "how", "said", "an", "each", "she", "which",
+        "do", "their", "time", "if", "will", "way", "about", "many", "then", "them", "write", "would", "like",
+        "so", "these", "her", "long", "make", "thing", "see", "him", "two", "has", "look", "more", "day", "could",
+        "go", "come", "did", "number", "sound", "no", "most", "people", "my", "over", "know", "water", "than",
+        "call", "first", "who", "may", "down", "side", "been", "now", "find", "government", "understanding",
+        "nevertheless", "approximately", "responsibility", "infrastructure", "photosynthesis", "circumstances" };
+    const char *const syllables[] = { "ka", "tor", "mi", "lun", "es", "pra", "vel", "dio", "quen", "sy", "rath",
+        "bo", "gle", "nim", "ux", "tal" };
+    std::mt19937 rng(17);
+    while (vocabulary.size() < 20000) {
+        tiktoken::tt_stl::string word;
+        for (size_t count = 2 + rng() % 3; count > 0; --count) {
+            word += syllables[rng() % std::size(syllables)];
+        }
+        vocabulary.push_back(std::move(word));
+    }
+    const size_t real_words = 108;
+    tiktoken::tt_stl::vector<double> weights;
+    for (size_t rank = 1; rank <= vocabulary.size(); ++rank) {
+        weights.push_back((rank <= real_words ? 1.0 : 0.25) / static_cast<double>(rank));
+    }
+    std::discrete_distribution<size_t> words(weights.begin(), weights.end());
+
+    tiktoken::tt_stl::string result;
+    size_t sentence_length = 0;
+    while (result.size() < corpus_size) {
+        tiktoken::tt_stl::string word = vocabulary[words(rng)];
+        if (sentence_length == 0) {
+            word[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(word[0])));
+        } else {
+            result += ' ';
+        }
+        result += word;
+        if (++sentence_length > 8 + rng() % 12) {
+            result += rng() % 6 == 0 ? ".\n\n" : ". ";
+            sentence_length = 0;
+        } else if (rng() % 12 == 0) {
+            result += ',';
+        }
+    }
+    return result;
+}
+
+// Functions of a few statements each: declarations, calls, conditions and loops over made-up identifiers.
+tiktoken::tt_stl::string make_code()
+{
+    const char *const parts[] = { "buffer", "count", "index", "node", "value", "result", "size", "offset", "token",
+        "table", "entry", "state", "next", "prev", "data", "length", "config", "handle", "item", "key" };
+    const char *const types[] = { "int", "size_t", "const char *", "uint32_t", "bool", "auto", "std::string" };
+    const char *const operators[] = { " + ", " - ", " * ", " / ", " % ", " << ", " >> ", " & ", " | ", " ^ " };
+    std::mt19937 rng(23);
+    auto identifier = [&] {
+        tiktoken::tt_stl::string name = parts[rng() % std::size(parts)];
+        if (rng() % 2 == 0) {
+            tiktoken::tt_stl::string second = parts[rng() % std::size(parts)];
+            second[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(second[0])));
+            name += second;
+        }
+        return name;
+    };
+    auto expression = [&] {
+        tiktoken::tt_stl::string expr = identifier();
+        for (size_t terms = rng() % 3; terms > 0; --terms) {
+            expr += operators[rng() % std::size(operators)];
+            expr += rng() % 3 == 0 ? tiktoken::tt_stl::to_string(rng() % 4096) : identifier();
+        }
+        return expr;
+    };
+
+    tiktoken::tt_stl::string result;
+    while (result.size() < corpus_size) {
+        result += "// Updates the " + identifier() + " of every " + identifier() + " in the table.\n";
+        result += "static " + tiktoken::tt_stl::string(types[rng() % std::size(types)]) + " " + identifier() + "(";
+        result += tiktoken::tt_stl::string(types[rng() % std::size(types)]) + " " + identifier() + ", int "
+            + identifier() + ")\n{\n";
+        for (size_t statements = 2 + rng() % 6; statements > 0; --statements) {
+            const tiktoken::tt_stl::string indent(4 * (1 + rng() % 2), ' ');
+            switch (rng() % 4) {
+                case 0:
+                    result += indent + types[rng() % std::size(types)] + " " + identifier() + " = " + expression()
+                        + ";\n";
+                    break;
+                case 1:
+                    result += indent + "if (" + expression() + " > " + tiktoken::tt_stl::to_string(rng() % 100)
+                        + ") {\n";
+                    result += indent + "    return " + expression() + ";\n" + indent + "}\n";
+                    break;
+                case 2:
+                    result += indent + "for (int i = 0; i < " + identifier() + ".size(); ++i) {\n";
+                    result += indent + "    " + identifier() + "[i] += " + expression() + ";\n" + indent + "}\n";
+                    break;
+                default:
+                    result += indent + identifier() + "(\"" + identifier() + ": %d\\n\", " + expression() + ");\n";
+                    break;
+            }
+        }
+        result += "}\n\n";
+    }
+    return result;
+}
+
+// Characters from the CJK Unified Ideographs block, drawn with Zipf's law so that a few thousand of them make up
+// nearly all of the text, as in real Chinese, with a sentence's worth of them between punctuation marks.
+tiktoken::tt_stl::string make_cjk()
+{
+    std::mt19937 rng(29);
+    // Spread the commonest ranks over the block rather than taking its first characters in order
+    tiktoken::tt_stl::vector<uint32_t> characters;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        characters.push_back(0x4E00 + (i * 2654435761u) % (0x9FFF - 0x4E00));
+    }
+    auto character = zipf(characters.size());
+    const uint32_t punctuation[] = { 0xFF0C, 0x3002, 0x3001, 0xFF1B, 0xFF1F, 0xFF01 };
+
+    tiktoken::tt_stl::string result;
+    while (result.size() < corpus_size) {
+        for (size_t length = 4 + rng() % 20; length > 0; --length) {
+            append_code_point(result, characters[character(rng)]);
+        }
+        append_code_point(result, punctuation[rng() % std::size(punctuation)]);
+        if (rng() % 10 == 0) {
+            result += '\n';
+        }
+    }
+    return result;
+}
+
+// Single emoji, emoji with a skin tone, flags and family ZWJ sequences, in runs and between short words.
+tiktoken::tt_stl::string make_emoji()
+{
+    const char *const words[] = { "so", "good", "lol", "yes", "love", "this", "omg", "wow", "thanks", "party" };
+    std::mt19937 rng(31);
+    tiktoken::tt_stl::string result;
+    while (result.size() < corpus_size) {
+        if (rng() % 3 == 0) {
+            result += words[rng() % std::size(words)];
+            result += ' ';
+        }
+        for (size_t run = 1 + rng() % 4; run > 0; --run) {
+            switch (rng() % 5) {
+                case 0:
+                    // Skin tones follow a hand
+                    append_code_point(result, 0x1F44B + rng() % 6);
+                    append_code_point(result, 0x1F3FB + rng() % 5);
+                    break;
+                case 1:
+                    // A regional indicator pair, which shows as a flag
+                    append_code_point(result, 0x1F1E6 + rng() % 26);
+                    append_code_point(result, 0x1F1E6 + rng() % 26);
+                    break;
+                case 2:
+                    // Family: man ZWJ woman ZWJ child
+                    append_code_point(result, 0x1F468);
+                    append_code_point(result, 0x200D);
+                    append_code_point(result, 0x1F469);
+                    append_code_point(result, 0x200D);
+                    append_code_point(result, 0x1F466 + rng() % 2);
+                    break;
+                default:
+                    append_code_point(result, 0x1F600 + rng() % 0x50);
+                    break;
+            }
+        }
+        result += rng() % 8 == 0 ? "\n" : " ";
+    }
+    return result;
+}
+
+// Runs of spaces, tabs and newlines whose lengths spread over several orders of magnitude.
+tiktoken::tt_stl::string make_whitespace()
+{
+    const char *const words[] = { "alpha", "beta", "gamma", "delta", "x", "42", "end" };
+    const char blanks[] = { ' ', ' ', ' ', '\t', '\n' };
+    std::mt19937 rng(37);
+    tiktoken::tt_stl::string result;
+    while (result.size() < corpus_size) {
+        result += words[rng() % std::size(words)];
+        const size_t length = size_t(1) << (rng() % 13);
+        const bool mixed = rng() % 2 == 0;
+        for (size_t i = 0; i < length; ++i) {
+            result += mixed ? blanks[rng() % std::size(blanks)] : ' ';
+        }
+    }
+    return result;
+}
+
+// Numbers from one digit to thousands of them, in the forms they take in tables, prices and identifiers.
+tiktoken::tt_stl::string make_digits()
+{
+    const char *const separators[] = { " ", ", ", ".", "-", ":", "\n", " $", "#" };
+    std::mt19937 rng(41);
+    tiktoken::tt_stl::string result;
+    while (result.size() < corpus_size) {
+        const size_t magnitude = size_t(1) << (rng() % 13);
+        const size_t length = 1 + rng() % magnitude;
+        for (size_t i = 0; i < length; ++i) {
+            result += static_cast<char>('0' + rng() % 10);
+        }
+        result += separators[rng() % std::size(separators)];
+    }
+    return result;
+}
+
+tiktoken::tt_stl::string make_worst_case(WorstCase kind)
+{
+    std::mt19937 rng(43);
+    tiktoken::tt_stl::string result;
+    switch (kind) {
+        case WorstCase::LetterPiece:
+            while (result.size() < corpus_size) {
+                result += static_cast<char>('a' + rng() % 26);
+            }
+            break;
+        case WorstCase::RepeatedByte:
+            result.assign(corpus_size, 'a');
+            break;
+        case WorstCase::RandomBytes:
+            while (result.size() < corpus_size) {
+                result += static_cast<char>(rng() % 256);
+            }
+            break;
+        case WorstCase::SpecialPrefixes:
+            while (result.size() < corpus_size) {
+                result += "<|endoftext";
+            }
+            break;
+        case WorstCase::COUNT:
+            break;
+    }
+    return result;
+}
+
+}
+
+const tiktoken::tt_stl::string &corpus(Corpus kind)
+{
+    static const auto corpora = [] {
+        std::array<tiktoken::tt_stl::string, static_cast<size_t>(Corpus::COUNT)> result;
+        result[static_cast<size_t>(Corpus::English)] = make_english();
+        result[static_cast<size_t>(Corpus::Code)] = make_code();
+        result[static_cast<size_t>(Corpus::Cjk)] = make_cjk();
+        result[static_cast<size_t>(Corpus::Emoji)] = make_emoji();
+        result[static_cast<size_t>(Corpus::Whitespace)] = make_whitespace();
+        result[static_cast<size_t>(Corpus::Digits)] = make_digits();
+        return result;
+    }();
+    return corpora[static_cast<size_t>(kind)];
+}
+
+const char *corpus_name(Corpus kind)
+{
+    constexpr const char *names[static_cast<size_t>(Corpus::COUNT)] = { "english", "code", "cjk", "emoji", "whitespace",
+        "digits" };
+    return names[static_cast<size_t>(kind)];
+}
+
+const tiktoken::tt_stl::string &worst_case(WorstCase kind)
+{
+    static const auto cases = [] {
+        std::array<tiktoken::tt_stl::string, static_cast<size_t>(WorstCase::COUNT)> result;
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = make_worst_case(static_cast<WorstCase>(i));
+        }
+        return result;
+    }();
+    return cases[static_cast<size_t>(kind)];
+}
+
+const char *worst_case_name(WorstCase kind)
+{
+    constexpr const char *names[static_cast<size_t>(WorstCase::COUNT)] = { "letter_piece", "repeated_byte",
+        "random_bytes", "special_prefixes" };
+    return names[static_cast<size_t>(kind)];
+}
+
+const char *model_name(tiktoken::LanguageModel model)
+{
+    constexpr const char *names[static_cast<size_t>(tiktoken::LanguageModel::COUNT)] = { "o200k_base", "cl100k_base",
+        "r50k_base", "p50k_base", "p50k_edit" };
+    return names[static_cast<size_t>(model)];
+}
+
+}
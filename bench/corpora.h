@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+#include "modelparams.h"
+
+namespace bench
+{
+
+// Generated text the benchmarks encode. Every corpus comes from a fixed seed, so runs from different commits measure
+// the same bytes and their results can be compared.
+enum class Corpus {
+    English,    // prose with Zipf-distributed words, some of them rare enough to take several tokens
+    Code,       // C-like source with indentation, identifiers, literals and comments
+    Cjk,        // Chinese text drawn from the commoner characters, with CJK punctuation
+    Emoji,      // emoji, skin tones and ZWJ sequences between short words
+    Whitespace, // short words between runs of up to thousands of spaces, tabs and newlines
+    Digits,     // runs of up to thousands of digits between punctuation
+    COUNT
+};
+
+// Inputs that are slow for one stage in particular rather than typical of real text.
+enum class WorstCase {
+    LetterPiece,     // random letters without a break, one pre-token that byte_pair_merge takes whole
+    RepeatedByte,    // a single letter repeated, one pre-token whose every pair has the same rank
+    RandomBytes,     // random bytes, mostly ill-formed UTF-8
+    SpecialPrefixes, // "<|endoftext" over and over, a special token that never completes
+    COUNT
+};
+
+// About 1 MB of each.
+constexpr size_t corpus_size = 1 << 20;
+
+const tiktoken::tt_stl::string &corpus(Corpus kind);
+const char *corpus_name(Corpus kind);
+
+const tiktoken::tt_stl::string &worst_case(WorstCase kind);
+const char *worst_case_name(WorstCase kind);
+
+// The name of the vocabulary file model loads, such as "cl100k_base".
+const char *model_name(tiktoken::LanguageModel model);
+
+}
@@ -0,0 +1,214 @@
+#include "binary_vocabulary.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tiktoken
+{
+
+namespace
+{
+    static_assert(sizeof(BinaryVocabularyHeader) == 64, "the header layout is part of the file format");
+    static_assert(sizeof(RankTable::Slot) == 4, "the slot layout is part of the file format");
+
+    BinaryVocabulary invalid_vocabulary(const char *message)
+    {
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+        throw std::runtime_error(message);
+#else
+        (void) message;
+        return {};
+#endif
+    }
+
+    size_t align8(size_t offset)
+    {
+        return (offset + 7) & ~size_t(7);
+    }
+
+    // A read-only mapping of a whole file, unmapped when the last RankTable using it goes away.
+    class mapped_file_t
+    {
+    public:
+        explicit mapped_file_t(const tt_stl::string &path)
+        {
+#ifdef _WIN32
+            const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return;
+            }
+            LARGE_INTEGER file_size;
+            if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+                const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping) {
+                    data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    size_ = data_ ? static_cast<size_t>(file_size.QuadPart) : 0;
+                    CloseHandle(mapping);
+                }
+            }
+            CloseHandle(file);
+#else
+            const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file < 0) {
+                return;
+            }
+            struct stat file_stat {};
+            if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+                void *const data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, file, 0);
+                if (data != MAP_FAILED) {
+                    data_ = data;
+                    size_ = static_cast<size_t>(file_stat.st_size);
+                }
+            }
+            close(file);
+#endif
+        }
+
+        ~mapped_file_t()
+        {
+            if (!data_) {
+                return;
+            }
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+#else
+            munmap(data_, size_);
+#endif
+        }
+
+        mapped_file_t(const mapped_file_t &) = delete;
+        mapped_file_t &operator=(const mapped_file_t &) = delete;
+
+        [[nodiscard]] std::span<const uint8_t> bytes() const { return { static_cast<const uint8_t *>(data_), size_ }; }
+
+    private:
+        void *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    template <typename T>
+    void append(tt_stl::vector<uint8_t> &image, const T *values, size_t count)
+    {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(values);
+        image.insert(image.end(), bytes, bytes + sizeof(T) * count);
+    }
+}
+
+BinaryVocabulary BinaryVocabulary::map_file(const tt_stl::string &path)
+{
+    auto file = std::make_shared<const mapped_file_t>(path);
+    if (file->bytes().empty()) {
+        return invalid_vocabulary("Cannot map binary vocabulary file");
+    }
+    return from_image(file->bytes(), file);
+}
+
+BinaryVocabulary BinaryVocabulary::from_image(std::span<const uint8_t> image, std::shared_ptr<const void> owner,
+    bool trusted)
+{
+    if constexpr (std::endian::native != std::endian::little) {
+        return invalid_vocabulary("Binary vocabularies are only supported on little-endian targets");
+    }
+    BinaryVocabularyHeader header {};
+    if (image.size() < sizeof(header) || reinterpret_cast<uintptr_t>(image.data()) % 8 != 0) {
+        return invalid_vocabulary("Binary vocabulary is truncated or misaligned");
+    }
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version) {
+        return invalid_vocabulary("Not a binary vocabulary of a supported version");
+    }
+
+    const auto section_fits = [&image](uint64_t offset, uint64_t size) {
+        return offset % 8 == 0 && offset <= image.size() && size <= image.size() - offset;
+    };
+    const uint64_t offsets_size = (uint64_t(header.token_count) + 1) * sizeof(uint32_t);
+    const uint64_t slots_size = uint64_t(header.slot_count) * sizeof(RankTable::Slot);
+    if (header.file_size != image.size() || !section_fits(header.offsets_offset, offsets_size)
+        || !section_fits(header.slots_offset, slots_size) || header.bytes_offset > image.size()
+        || header.specials_offset > image.size()) {
+        return invalid_vocabulary("Binary vocabulary sections are out of bounds");
+    }
+    const auto *offsets = reinterpret_cast<const uint32_t *>(image.data() + header.offsets_offset);
+    const auto *slots = reinterpret_cast<const RankTable::Slot *>(image.data() + header.slots_offset);
+    const uint8_t *bytes = image.data() + header.bytes_offset;
+    const size_t byte_size = image.size() - header.bytes_offset;
+    if (trusted ? offsets[header.token_count] > byte_size
+                : !RankTable::is_valid(header.token_count, offsets, header.slot_count, slots, byte_size)) {
+        return invalid_vocabulary("Binary vocabulary index is corrupt");
+    }
+
+    BinaryVocabulary vocabulary;
+    size_t position = header.specials_offset;
+    for (uint32_t i = 0; i < header.special_count; ++i) {
+        uint32_t entry[2];
+        if (image.size() - position < sizeof(entry)) {
+            return invalid_vocabulary("Binary vocabulary special tokens are truncated");
+        }
+        std::memcpy(entry, image.data() + position, sizeof(entry));
+        position += sizeof(entry);
+        if (image.size() - position < entry[1]) {
+            return invalid_vocabulary("Binary vocabulary special tokens are truncated");
+        }
+        vocabulary.special_tokens.insert({ tt_stl::string(reinterpret_cast<const char *>(image.data() + position), entry[1]),
+            static_cast<int>(entry[0]) });
+        position += entry[1];
+    }
+    vocabulary.ranks = RankTable(header.token_count, offsets, header.slot_count, slots, bytes, std::move(owner));
+    return vocabulary;
+}
+
+bool BinaryVocabulary::write_file(const tt_stl::string &path, const RankTable &ranks,
+    const tt_stl::unordered_map<tt_stl::string, int> &special_tokens)
+{
+    BinaryVocabularyHeader header {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.token_count = ranks.token_count();
+    header.slot_count = ranks.slot_count();
+    header.special_count = static_cast<uint32_t>(special_tokens.size());
+    header.offsets_offset = sizeof(header);
+    header.slots_offset = align8(header.offsets_offset + (size_t(header.token_count) + 1) * sizeof(uint32_t));
+    header.bytes_offset = header.slots_offset + size_t(header.slot_count) * sizeof(RankTable::Slot);
+    header.specials_offset = align8(header.bytes_offset + ranks.byte_size());
+
+    // Specials are written in id order so the output does not depend on hash map iteration order.
+    tt_stl::vector<std::pair<int, const tt_stl::string *>> specials;
+    for (const auto &special_token: special_tokens) {
+        specials.emplace_back(special_token.second, &special_token.first);
+    }
+    std::sort(specials.begin(), specials.end());
+
+    tt_stl::vector<uint8_t> image;
+    append(image, &header, 1);
+    append(image, ranks.offsets(), size_t(header.token_count) + 1);
+    image.resize(header.slots_offset);
+    append(image, ranks.slots(), header.slot_count);
+    append(image, ranks.byte_data(), ranks.byte_size());
+    image.resize(header.specials_offset);
+    for (const auto &[id, token]: specials) {
+        const uint32_t entry[2] = { static_cast<uint32_t>(id), static_cast<uint32_t>(token->size()) };
+        append(image, entry, 2);
+        append(image, token->data(), token->size());
+    }
+    header.file_size = image.size();
+    std::memcpy(image.data(), &header, sizeof(header));
+
+    FILE *const file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+    return std::fclose(file) == 0 && written;
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common.h"
+#include "rank_table.h"
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+namespace tiktoken
+{
+
+// A vocabulary precompiled by tools/tiktoken_to_binary.py. The file holds a RankTable exactly as it is laid out in
+// memory, so it is mapped read-only and searched in place instead of being parsed; processes that map the same file
+// share its pages. All integers are little-endian. The offsets, slots and specials sections start on 8-byte
+// boundaries; bytes follows slots directly, so it is only 4-byte aligned:
+//
+//     header    BinaryVocabularyHeader
+//     offsets   uint32_t[token_count + 1]
+//     slots     RankTable::Slot[slot_count]
+//     bytes     uint8_t[offsets[token_count]]
+//     specials  special_count times { uint32_t id; uint32_t length; uint8_t bytes[length]; }
+struct BinaryVocabularyHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t token_count;
+    uint32_t slot_count;
+    uint32_t special_count;
+    uint64_t offsets_offset;
+    uint64_t slots_offset;
+    uint64_t bytes_offset;
+    uint64_t specials_offset;
+    uint64_t file_size;
+};
+
+class BinaryVocabulary {
+public:
+    static constexpr char Magic[8] = { 'T', 'T', 'K', 'V', 'O', 'C', 'A', 'B' };
+    static constexpr uint32_t Version = 2;
+
+    RankTable ranks;
+    // Empty if the file stores no special tokens, in which case the model's defaults apply.
+    tt_stl::unordered_map<tt_stl::string, int> special_tokens;
+
+    // Maps the file at path. The result has no ranks if the file cannot be mapped or is not a valid vocabulary.
+    static BinaryVocabulary map_file(const tt_stl::string &path);
+    // Reads a vocabulary image that is already in memory, aligned to 8 bytes. owner keeps the image alive for as
+    // long as the ranks refer to it. trusted skips checking the index, for images the build itself produced.
+    static BinaryVocabulary from_image(std::span<const uint8_t> image, std::shared_ptr<const void> owner,
+        bool trusted = false);
+    // Writes the same format as tools/tiktoken_to_binary.py.
+    static bool write_file(const tt_stl::string &path, const RankTable &ranks,
+        const tt_stl::unordered_map<tt_stl::string, int> &special_tokens);
+};
+
+}
@@ -16,160 +16,487 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "byte_pair_encoding.h"
+#include "encode_stats.h"
+#include "encoding_utils.h"
 #include "pcre2_regex.h"
+#include <cstring>
+#include <functional>
 #include <limits>
-#include <optional>
-#include <sstream>
 #include <string>
 #include <algorithm>
+#include <type_traits>
 
 namespace tiktoken
 {
 
-BytePairEncodingCore::BytePairEncodingCore(bpe_encoding_t&& byte_pair_ranks,
+namespace
+{
+    // Whether sink is called as sink(token, bytes) rather than sink(token).
+    template <typename Sink>
+    constexpr bool takes_token_bytes = std::is_invocable_v<Sink &, int, std::span<const uint8_t>>;
+
+    // Hands token to sink, along with the bytes it stands for if the sink takes them.
+    template <typename Sink>
+    void emit_token(Sink &sink, int token, std::span<const uint8_t> bytes)
+    {
+        encode_stats_detail::count_token();
+        if constexpr (takes_token_bytes<Sink>) {
+            sink(token, bytes);
+        } else {
+            sink(token);
+        }
+    }
+}
+
+BytePairEncodingCore::BytePairEncodingCore(RankTable&& rank_table,
     tt_stl::unordered_map<tt_stl::string, int>&& special_token_mappings,
-    PCRERegex&& pattern_string) :
-    byte_pair_ranks_(std::move(byte_pair_ranks)),
+    PCRERegex&& pattern_string,
+    PreTokenizerPattern pre_tokenizer) :
+    byte_pair_ranks_(std::make_shared<BytePairRanks>()),
+    rank_table_(std::move(rank_table)),
     special_token_mappings_(std::move(special_token_mappings)),
-    pattern_string_(std::move(pattern_string)) { }
+    special_token_matcher_(special_token_mappings_),
+    pattern_string_(std::move(pattern_string)),
+    pre_tokenizer_(pre_tokenizer)
+{
+    build_decoder();
+}
 
-tt_stl::vector<int> BytePairEncodingCore::byte_pair_merge(const tt_stl::vector<uint8_t> &piece,
-    const bpe_encoding_t &ranks,
-    const std::function<int(int, int)> &f)
+void BytePairEncodingCore::build_decoder()
 {
-    tt_stl::vector<std::pair<int, int>> partitions(piece.size() + 1);
-    for (size_t i = 0; i <= piece.size(); ++i) {
-        partitions[i] = { static_cast<int>(i), std::numeric_limits<int>::max() };
+    for (int byte = 0; byte < 256; ++byte) {
+        const uint8_t piece[1] = { static_cast<uint8_t>(byte) };
+        byte_ranks_[byte] = rank_table_.find(piece);
     }
-    auto get_rank = [&piece, &partitions, &ranks](size_t idx, int skip) -> std::optional<int> {
-        if (idx + skip + 2 >= partitions.size()) {
-            return std::nullopt;
+
+    special_decoder_.clear();
+    special_bytes_.clear();
+    int first = std::numeric_limits<int>::max();
+    int last = -1;
+    for (const auto &special_token: special_token_mappings_) {
+        if (special_token.second >= 0) {
+            first = std::min(first, special_token.second);
+            last = std::max(last, special_token.second);
+        }
+    }
+    if (last < 0) {
+        return;
+    }
+    special_base_ = static_cast<uint32_t>(first);
+    special_decoder_.assign(static_cast<size_t>(last - first) + 1, SpecialEntry { 0, -1 });
+    for (const auto &special_token: special_token_mappings_) {
+        if (special_token.second >= 0) {
+            special_decoder_[static_cast<size_t>(special_token.second - first)] = {
+                static_cast<uint32_t>(special_bytes_.size()), static_cast<int32_t>(special_token.first.size()) };
+            special_bytes_ += special_token.first;
+        }
+    }
+}
+
+const bpe_encoding_t &BytePairEncodingCore::getBytePairRanks() const
+{
+    std::call_once(byte_pair_ranks_->built, [this] { byte_pair_ranks_->ranks = rank_table_.to_map(); });
+    return byte_pair_ranks_->ranks;
+}
+
+std::span<const uint8_t> BytePairEncodingCore::token_bytes(int token_id) const
+{
+    // A negative id wraps around to far past the overlay
+    const uint32_t index = static_cast<uint32_t>(token_id) - special_base_;
+    if (index < special_decoder_.size() && special_decoder_[index].size >= 0) {
+        const SpecialEntry special = special_decoder_[index];
+        return { reinterpret_cast<const uint8_t *>(special_bytes_.data()) + special.offset,
+            static_cast<size_t>(special.size) };
+    }
+    return rank_table_.bytes(token_id);
+}
+
+int BytePairEncodingCore::max_token_id() const
+{
+    const int max_rank = static_cast<int>(rank_table_.token_count()) - 1;
+    return special_decoder_.empty()
+        ? max_rank
+        : std::max(max_rank, static_cast<int>(special_base_ + special_decoder_.size() - 1));
+}
+
+template <typename Sink>
+void BytePairEncodingCore::byte_pair_merge(std::span<const uint8_t> piece,
+    const RankTable &ranks,
+    MergeScratch &scratch,
+    Sink &sink)
+{
+    constexpr int no_rank = std::numeric_limits<int>::max();
+    const int piece_size = static_cast<int>(piece.size());
+    if (piece_size == 0) {
+        return;
+    }
+    const int whole_piece = ranks.find(piece);
+    if (whole_piece >= 0) {
+        emit_token(sink, whole_piece, piece);
+        return;
+    }
+
+    // Parts are keyed by the byte offset they start at and kept in a doubly-linked list, so a merge only has to
+    // unlink the right-hand part and re-rank its two neighbours. Candidate merges live in a min-heap ordered by
+    // (rank, offset), which picks the same lowest-rank, leftmost pair the reference algorithm would; entries made
+    // stale by an earlier merge are skipped when they are popped.
+    auto &next = scratch.next;
+    auto &prev = scratch.prev;
+    auto &rank = scratch.rank;
+    auto &token = scratch.token;
+    auto &heap = scratch.heap;
+    encode_stats_detail::count_growth(next, piece_size + 1);
+    next.resize(piece_size + 1);
+    prev.resize(piece_size + 1);
+    rank.assign(piece_size + 1, no_rank);
+    token.assign(piece_size + 1, -1);
+    heap.clear();
+    for (int i = 0; i <= piece_size; ++i) {
+        next[i] = i + 1;
+        prev[i] = i - 1;
+    }
+
+    auto get_rank = [&piece, &next, &ranks, piece_size](int start) -> int {
+        const int middle = next[start];
+        if (middle >= piece_size) {
+            return no_rank;
         }
-        tt_stl::vector<uint8_t> key(piece.begin() + partitions[idx].first, piece.begin() + partitions[idx + skip + 2].first);
-        auto rank_iter = ranks.find(key);
-        return (rank_iter != ranks.end()) ? std::optional<int>(rank_iter->second) : std::nullopt;
+        const int found = ranks.find(piece.subspan(start, next[middle] - start));
+        return found >= 0 ? found : no_rank;
     };
-    for (size_t i = 0; i < partitions.size() - 2; ++i) {
-        auto rank = get_rank(i, 0);
-        if (rank.has_value()) {
-            partitions[i].second = rank.value();
-        }
-    }
-    while (partitions.size() > 1) {
-        int min_rank = std::numeric_limits<int>::max();
-        size_t min_rank_idx = 0;
-        for (size_t i = 0; i < partitions.size() - 1; ++i) {
-            if (partitions[i].second < min_rank) {
-                min_rank = partitions[i].second;
-                min_rank_idx = i;
-            }
+    auto push_candidate = [&heap](int candidate_rank, int start) {
+        if (candidate_rank != no_rank) {
+            heap.emplace_back(candidate_rank, start);
+            std::push_heap(heap.begin(), heap.end(), std::greater<>());
         }
-        if (min_rank != std::numeric_limits<int>::max()) {
-            partitions[min_rank_idx].second = get_rank(min_rank_idx, 1).value_or(std::numeric_limits<int>::max());
+    };
 
-            if (min_rank_idx > 0) {
-                partitions[min_rank_idx - 1].second = get_rank(min_rank_idx - 1, 1).value_or(std::numeric_limits<int>::max());
-            }
-            partitions.erase(partitions.begin() + static_cast<long long>(min_rank_idx) + 1);
+    for (int i = 0; i + 1 < piece_size; ++i) {
+        rank[i] = get_rank(i);
+        push_candidate(rank[i], i);
+    }
+
+    size_t merges = 0;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+        const auto [candidate_rank, start] = heap.back();
+        heap.pop_back();
+        if (rank[start] != candidate_rank) {
+            continue;
+        }
+
+        const int removed = next[start];
+        next[start] = next[removed];
+        prev[next[removed]] = start;
+        rank[removed] = no_rank;
+        token[start] = candidate_rank;
+        ++merges;
+
+        rank[start] = get_rank(start);
+        push_candidate(rank[start], start);
+        if (prev[start] >= 0) {
+            rank[prev[start]] = get_rank(prev[start]);
+            push_candidate(rank[prev[start]], prev[start]);
+        }
+    }
+    encode_stats_detail::count_merges(merges);
+
+    for (int i = 0; i < piece_size; i = next[i]) {
+        if (token[i] >= 0) {
+            emit_token(sink, token[i], piece.subspan(i, next[i] - i));
         } else {
-            break;
+            const int found = ranks.find(piece.subspan(i, 1));
+            if (found >= 0) {
+                emit_token(sink, found, piece.subspan(i, 1));
+            }
         }
     }
-    tt_stl::vector<int> output;
-    output.reserve(partitions.size() - 1);
-    for (size_t i = 0; i < partitions.size() - 1; ++i) {
-        output.push_back(f(partitions[i].first, partitions[i + 1].first));
+}
+
+template <typename Sink>
+void BytePairEncodingCore::merge_cached(std::span<const uint8_t> piece, MergeScratch &scratch, Sink &sink) const
+{
+    // A piece that is a token is found as fast in the rank table as it would be in the cache
+    const uint64_t hash = rank_table_hash(piece);
+    const int whole_piece = rank_table_.find(piece, hash);
+    if (whole_piece >= 0) {
+        emit_token(sink, whole_piece, piece);
+        return;
+    }
+    // Merging writes up to one token per byte here, more than an entry holds; insert drops what does not fit.
+    int tokens[PieceCache::max_piece_size];
+    size_t count = piece_cache_->find(piece, hash, tokens);
+    if (count == 0) {
+        auto collect = [&tokens, &count](int token) { tokens[count++] = token; };
+        byte_pair_merge(piece, rank_table_, scratch, collect);
+        piece_cache_->insert(piece, hash, std::span<const int>(tokens, count));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        emit_token(sink, tokens[i], {});
     }
-    return output;
 }
 
+void BytePairEncodingCore::set_piece_cache_capacity(size_t capacity)
+{
+    piece_cache_ = capacity > 0 ? std::make_unique<PieceCache>(capacity) : nullptr;
+}
 
-tt_stl::vector<tt_stl::string> BytePairEncodingCore::break_into_specials(tt_stl::string const& line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special) {
-    tt_stl::vector<std::pair<size_t, size_t>> separator_offsets;
-    tt_stl::string::size_type pos = 0;
-    for (auto& sep: special_token_mappings_) {
-        if (!sep.first.empty()) {
-            while ((pos = line_to_encode.find(sep.first, pos)) != tt_stl::string::npos) {
-                separator_offsets.push_back({ pos, pos + sep.first.size() });
-                pos += sep.first.size();
-            }
-            pos = 0;
-        } else if (allowed_special.count("")) {
-            separator_offsets.push_back({ 0, 0 });
-        }
+PieceCacheStats BytePairEncodingCore::piece_cache_stats() const
+{
+    return piece_cache_ ? piece_cache_->stats() : PieceCacheStats {};
+}
+
+BytePairEncodingCore::MergeScratch &BytePairEncodingCore::thread_merge_scratch()
+{
+    // Reused by every encode on the thread, so once it has grown to the longest piece seen, merging does not allocate.
+    thread_local MergeScratch scratch;
+    return scratch;
+}
+
+template <typename Callback>
+void BytePairEncodingCore::for_each_segment(std::string_view line_to_encode,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, Callback &&callback, size_t search_from) const
+{
+    // Segments alternate between plain text and special tokens, starting and ending with (possibly empty) text.
+    if (special_token_mappings_.count("") > 0 && allowed_special.count("") > 0) {
+        callback(line_to_encode.substr(0, 0), false);
+        callback(line_to_encode.substr(0, 0), true);
     }
-    std::sort(separator_offsets.begin(), separator_offsets.end());
-    tt_stl::vector<tt_stl::string> lines;
-    for (auto [begin, end]: separator_offsets) {
-        lines.push_back(line_to_encode.substr(pos, begin - pos));
-        lines.push_back(line_to_encode.substr(begin, end - begin));
-        pos = end;
+    auto find_special = [this, line_to_encode](size_t from) {
+        encode_stats_detail::StageTimer timer(EncodeStage::SpecialTokens);
+        return special_token_matcher_.find(line_to_encode, from);
+    };
+    size_t pos = 0;
+    for (auto match = find_special(search_from); match.offset != std::string_view::npos; match = find_special(pos)) {
+        callback(line_to_encode.substr(pos, match.offset - pos), false);
+        callback(line_to_encode.substr(match.offset, match.length), true);
+        pos = match.offset + match.length;
     }
-    lines.push_back(line_to_encode.substr(pos, line_to_encode.size() - pos));
+    callback(line_to_encode.substr(pos), false);
+}
+
+scratch_vector<std::string_view> BytePairEncodingCore::break_into_specials(std::string_view line_to_encode,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, size_t search_from) const
+{
+    scratch_vector<std::string_view> lines(scratch_memory_resource());
+    for_each_segment(line_to_encode, allowed_special, [&lines](std::string_view segment, bool) {
+        lines.push_back(segment);
+    }, search_from);
     return lines;
 }
 
-std::pair<tt_stl::vector<int>, tt_stl::vector<int>> BytePairEncodingCore::encode_native(const tt_stl::string &line_to_encode,
-    const tt_stl::unordered_set<tt_stl::string> &allowed_special)
+bool BytePairEncodingCore::contains_special(std::string_view line_to_encode,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special) const
 {
-    tt_stl::vector<int> tokens;
-    tt_stl::vector<int> segment_ids;
-    auto lines = break_into_specials(line_to_encode, allowed_special);
-    for(auto line:lines) {
-        auto special_mapping = special_token_mappings_.find(line);
-        if (special_mapping != special_token_mappings_.end() && allowed_special.count(line) > 0) {
-            tokens.push_back(special_mapping->second);
-            segment_ids.push_back(0);
+    encode_stats_detail::StageTimer timer(EncodeStage::SpecialTokens);
+    return (special_token_mappings_.count("") > 0 && allowed_special.count("") > 0)
+        || special_token_matcher_.find(line_to_encode).offset != std::string_view::npos;
+}
+
+template <typename Sink>
+void BytePairEncodingCore::encode_segment(std::string_view segment, bool special,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated, MergeScratch &scratch,
+    Sink &sink) const
+{
+    encode_stats_detail::count_bytes_in(segment.size());
+    if (special) {
+        // Reusing the thread's key keeps long special tokens from allocating every time they occur
+        auto &special_token = scratch.special;
+        special_token.assign(segment.data(), segment.size());
+        auto special_mapping = special_token_mappings_.find(special_token);
+        if (special_mapping != special_token_mappings_.end() && allowed_special.count(special_token) > 0) {
+            emit_token(sink, special_mapping->second,
+                std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(segment.data()), segment.size()));
+            return;
+        }
+    }
+
+    auto encode_piece = [&](std::span<const uint8_t> piece) {
+        if (piece.size() == 1) {
+            if (byte_ranks_[piece[0]] >= 0) {
+                emit_token(sink, byte_ranks_[piece[0]], piece);
+            }
+            return;
+        }
+        // The cache keeps tokens only, so a sink that wants their bytes merges every piece itself
+        if constexpr (!takes_token_bytes<Sink>) {
+            if (piece_cache_ && piece.size() <= PieceCache::max_piece_size) {
+                merge_cached(piece, scratch, sink);
+                return;
+            }
+        }
+        byte_pair_merge(piece, rank_table_, scratch, sink);
+    };
+    auto encode_text = [&](std::string_view text) {
+        encode_stats_detail::PieceTimer timer;
+        auto on_piece = [&](size_t offset, size_t length) {
+            encode_stats_detail::count_piece(length);
+            timer.merge([&] {
+                encode_piece(std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(text.data()) + offset, length));
+            });
+        };
+        if (pre_tokenizer_ != PreTokenizerPattern::None) {
+            for_each_pre_token(pre_tokenizer_, text, on_piece);
         } else {
-            auto matches = pattern_string_.get_all_matches(line);
-            for (auto token: matches) {
-                auto special_mapping = special_token_mappings_.find(token);
-                if (special_mapping != special_token_mappings_.end() && allowed_special.count(token) > 0) {
-                    if (!token.empty()) {
-                        tokens.push_back(special_mapping->second);
-                        segment_ids.push_back(0);
-                    }
-                } else {
-                    tt_stl::vector<uint8_t> utf8_encoded(token.begin(), token.end());
-                    if (utf8_encoded.size() == 1) {
-                        auto rank_iter = byte_pair_ranks_.find(utf8_encoded);
-                        if (rank_iter != byte_pair_ranks_.end()) {
-                            tokens.push_back(rank_iter->second);
-                            segment_ids.push_back(0);
-                        }
-                    } else {
-                        auto byte_pairs = byte_pair_merge(utf8_encoded, byte_pair_ranks_, [&](int start, int end) {
-                            tt_stl::vector<uint8_t> key(utf8_encoded.begin() + start, utf8_encoded.begin() + end);
-                            return byte_pair_ranks_[key];
-                        });
-                        tokens.insert(tokens.end(), byte_pairs.begin(), byte_pairs.end());
-                        segment_ids.insert(segment_ids.end(), byte_pairs.size(), 0);
-                    }
-                }
+            pattern_string_.for_each_match(text, on_piece, true);
+        }
+    };
+
+    if (utf8_validated) {
+        encode_text(segment);
+        return;
+    }
+    // Bytes that are not part of well-formed UTF-8 are encoded one byte per token, and the valid runs between them
+    // are pre-tokenized on their own.
+    std::string_view remaining = segment;
+    while (!remaining.empty()) {
+        size_t invalid_offset;
+        {
+            encode_stats_detail::StageTimer timer(EncodeStage::Utf8Validation);
+            invalid_offset = std::min(utf8::find_invalid(remaining), remaining.size());
+        }
+        encode_text(remaining.substr(0, invalid_offset));
+        remaining.remove_prefix(invalid_offset);
+        if (!remaining.empty()) {
+            const size_t invalid_length = utf8::invalid_sequence_length(remaining);
+            for (size_t i = 0; i < invalid_length; ++i) {
+                encode_piece(std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(remaining.data()) + i, 1));
             }
+            remaining.remove_prefix(invalid_length);
         }
     }
-    return std::make_pair(tokens, segment_ids);
 }
 
-tt_stl::string BytePairEncodingCore::decode_native(const tt_stl::vector<int> &input_tokens_to_decode)
+tt_stl::vector<int> BytePairEncodingCore::encode_native(std::string_view line_to_encode,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated) const
+{
+    return encode_segments(break_into_specials(line_to_encode, allowed_special), allowed_special, utf8_validated);
+}
+
+tt_stl::vector<int> BytePairEncodingCore::encode_segments(std::span<const std::string_view> lines,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated) const
+{
+    tt_stl::vector<int> tokens;
+    encode_segments(lines, allowed_special, utf8_validated, tokens);
+    return tokens;
+}
+
+void BytePairEncodingCore::encode_segments(std::span<const std::string_view> lines,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated, tt_stl::vector<int> &tokens) const
+{
+    auto &scratch = thread_merge_scratch();
+    auto sink = [&tokens](int token) {
+        encode_stats_detail::count_growth(tokens, tokens.size() + 1);
+        tokens.push_back(token);
+    };
+    for (size_t line_index = 0; line_index < lines.size(); ++line_index) {
+        encode_segment(lines[line_index], line_index % 2 == 1, allowed_special, utf8_validated, scratch, sink);
+    }
+}
+
+void BytePairEncodingCore::encode_segment(std::string_view segment, bool special,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated, tt_stl::vector<int> &tokens) const
+{
+    auto sink = [&tokens](int token) {
+        encode_stats_detail::count_growth(tokens, tokens.size() + 1);
+        tokens.push_back(token);
+    };
+    encode_segment(segment, special, allowed_special, utf8_validated, thread_merge_scratch(), sink);
+}
+
+scratch_vector<std::string_view> BytePairEncodingCore::split_segment(std::string_view segment, size_t target_size) const
 {
-    tt_stl::string decoded_string;
+    scratch_vector<std::string_view> pieces(scratch_memory_resource());
+    size_t start = 0;
+    while (segment.size() - start > target_size) {
+        const size_t cut = find_pre_token_boundary(pre_tokenizer_, segment, start + target_size);
+        if (cut == segment.size()) {
+            break;
+        }
+        pieces.push_back(segment.substr(start, cut - start));
+        start = cut;
+    }
+    pieces.push_back(segment.substr(start));
+    return pieces;
+}
+
+void BytePairEncodingCore::encode_segments(std::span<const std::string_view> lines,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated, TokenBlockCallback emit,
+    void *context) const
+{
+    auto &scratch = thread_merge_scratch();
+    int block[256];
+    size_t count = 0;
+    auto sink = [&](int token) {
+        block[count++] = token;
+        if (count == std::size(block)) {
+            emit(context, std::span<const int>(block, count));
+            count = 0;
+        }
+    };
+    for (size_t line_index = 0; line_index < lines.size(); ++line_index) {
+        encode_segment(lines[line_index], line_index % 2 == 1, allowed_special, utf8_validated, scratch, sink);
+    }
+    if (count > 0) {
+        emit(context, std::span<const int>(block, count));
+    }
+}
+
+void BytePairEncodingCore::encode_with_offsets(std::string_view line_to_encode,
+    std::span<const std::string_view> segments, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    bool utf8_validated, tt_stl::vector<int> &tokens, tt_stl::vector<ByteRange> &offsets) const
+{
+    // Every piece is a view into line_to_encode, so where a token's bytes sit is its offset
+    const auto *base = reinterpret_cast<const uint8_t *>(line_to_encode.data());
+    auto sink = [&tokens, &offsets, base](int token, std::span<const uint8_t> bytes) {
+        const size_t start = static_cast<size_t>(bytes.data() - base);
+        encode_stats_detail::count_growth(tokens, tokens.size() + 1);
+        tokens.push_back(token);
+        offsets.push_back({ start, start + bytes.size() });
+    };
+    auto &scratch = thread_merge_scratch();
+    for (size_t line_index = 0; line_index < segments.size(); ++line_index) {
+        encode_segment(segments[line_index], line_index % 2 == 1, allowed_special, utf8_validated, scratch, sink);
+    }
+}
+
+size_t BytePairEncodingCore::count_native(std::string_view line_to_encode,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated) const
+{
+    auto &scratch = thread_merge_scratch();
+    size_t count = 0;
+    auto sink = [&count](int) { ++count; };
+    for_each_segment(line_to_encode, allowed_special, [&](std::string_view segment, bool special) {
+        encode_segment(segment, special, allowed_special, utf8_validated, scratch, sink);
+    });
+    return count;
+}
+
+size_t BytePairEncodingCore::decoded_size(std::span<const int> input_tokens_to_decode) const
+{
+    size_t size = 0;
     for (const int token_id: input_tokens_to_decode) {
-        auto special_token = std::find_if(special_token_mappings_.begin(), special_token_mappings_.end(),
-            [token_id](const auto &pair) { return pair.second == token_id; });
-        if (special_token != special_token_mappings_.end()) {
-            decoded_string += special_token->first;
-        } else {
-            for (const auto &byte_pair: byte_pair_ranks_) {
-                if (byte_pair.second == token_id) {
-                    decoded_string += tt_stl::string(byte_pair.first.begin(), byte_pair.first.end());
-                    break;
-                }
-            }
+        size += token_bytes(token_id).size();
+    }
+    return size;
+}
+
+void BytePairEncodingCore::decode_into(std::span<const int> input_tokens_to_decode, char *out) const
+{
+    for (const int token_id: input_tokens_to_decode) {
+        const auto bytes = token_bytes(token_id);
+        if (!bytes.empty()) {
+            std::memcpy(out, bytes.data(), bytes.size());
+            out += bytes.size();
         }
     }
+}
+
+tt_stl::string BytePairEncodingCore::decode_native(std::span<const int> input_tokens_to_decode) const
+{
+    tt_stl::string decoded_string(decoded_size(input_tokens_to_decode), '\0');
+    decode_into(input_tokens_to_decode, decoded_string.data());
     return decoded_string;
 }
 
-}
\ No newline at end of file
+}
@@ -19,8 +19,16 @@
 
 #include "common.h"
 #include "pcre2_regex.h"
-#include <functional>
+#include "piece_cache.h"
+#include "pretokenizer.h"
+#include "rank_table.h"
+#include "scratch_memory.h"
+#include "special_token_matcher.h"
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -28,29 +36,144 @@
 namespace tiktoken
 {
 
+// The bytes [start, end) of a text that a token stands for.
+struct ByteRange {
+    size_t start = 0;
+    size_t end = 0;
+
+    bool operator==(const ByteRange &) const = default;
+};
+
 class BytePairEncodingCore {
-    bpe_encoding_t byte_pair_ranks_;
+    // The map form of the ranks, which encoding itself never reads. It is filled in on the first getBytePairRanks
+    // call.
+    struct BytePairRanks {
+        std::once_flag built;
+        bpe_encoding_t ranks;
+    };
+    std::shared_ptr<BytePairRanks> byte_pair_ranks_;
+    RankTable rank_table_;
     tt_stl::unordered_map<tt_stl::string, int> special_token_mappings_;
+    SpecialTokenMatcher special_token_matcher_;
     PCRERegex pattern_string_;
+    // When set, pieces come from the hand-written matcher for the pattern instead of pattern_string_.
+    PreTokenizerPattern pre_tokenizer_;
+
+    // Ranks of the single bytes, -1 where a byte has none, so one-byte pieces skip the hash lookup.
+    int byte_ranks_[256];
+    // Tokens of recently merged pieces, or null when caching is off.
+    std::unique_ptr<PieceCache> piece_cache_;
+    // Special token ids continue the rank table's dense id space: entry i of special_decoder_ is the id
+    // special_base_ + i, its bytes a range of special_bytes_ or size -1 if that id is not a special token. Special
+    // ids sit just past the ranks in every vocabulary, so the overlay stays small. Special tokens decode before a
+    // byte pair rank that shares their id, as they always have.
+    struct SpecialEntry {
+        uint32_t offset;
+        int32_t size;
+    };
+    uint32_t special_base_ = 0;
+    tt_stl::vector<SpecialEntry> special_decoder_;
+    tt_stl::string special_bytes_;
 
-    static tt_stl::vector<int> byte_pair_merge(const tt_stl::vector<uint8_t> &piece,
-        const bpe_encoding_t &ranks,
-        const std::function<int(int, int)> &f);
+    // Working storage for byte_pair_merge, reused across the pieces and the encode calls of one thread.
+    struct MergeScratch {
+        tt_stl::vector<int> next;
+        tt_stl::vector<int> prev;
+        tt_stl::vector<int> rank;
+        tt_stl::vector<int> token;
+        tt_stl::vector<std::pair<int, int>> heap;
+        // A special token as the key special_token_mappings_ and allowed_special are looked up by.
+        tt_stl::string special;
+    };
+
+    void build_decoder();
+    static MergeScratch &thread_merge_scratch();
+
+    // The encoding pipeline hands each token to a sink, so encode and count_native share it. A sink is called as
+    // sink(token), or as sink(token, bytes) with the bytes of the input the token stands for if it takes them.
+    template <typename Sink>
+    static void byte_pair_merge(std::span<const uint8_t> piece,
+        const RankTable &ranks,
+        MergeScratch &scratch,
+        Sink &sink);
+    // byte_pair_merge through piece_cache_, for a piece of two to PieceCache::max_piece_size bytes.
+    template <typename Sink>
+    void merge_cached(std::span<const uint8_t> piece, MergeScratch &scratch, Sink &sink) const;
+    // Encodes one segment of break_into_specials. A special segment that is not allowed is encoded as text.
+    template <typename Sink>
+    void encode_segment(std::string_view segment, bool special, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+        bool utf8_validated, MergeScratch &scratch, Sink &sink) const;
+    // Calls callback(segment, special) for the segments break_into_specials returns, without storing them.
+    template <typename Callback>
+    void for_each_segment(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+        Callback &&callback, size_t search_from = 0) const;
 
 public:
-    BytePairEncodingCore(bpe_encoding_t&& byte_pair_ranks,
+    BytePairEncodingCore(RankTable&& rank_table,
         tt_stl::unordered_map<tt_stl::string, int>&& special_token_mappings,
-        PCRERegex&& pattern_string);
+        PCRERegex&& pattern_string,
+        PreTokenizerPattern pre_tokenizer = PreTokenizerPattern::None);
 
     BytePairEncodingCore(BytePairEncodingCore&&) = default;
     BytePairEncodingCore& operator=(BytePairEncodingCore&&) = default;
 
-    std::pair<tt_stl::vector<int>, tt_stl::vector<int>> encode_native(const tt_stl::string &line_to_encode,
-        const tt_stl::unordered_set<tt_stl::string> &allowed_special);
-    tt_stl::string decode_native(const tt_stl::vector<int> &input_tokens_to_decode);
-    tt_stl::vector<tt_stl::string> break_into_specials(tt_stl::string const& line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special);
+    // Set utf8_validated only when line_to_encode is known to be valid UTF-8. Otherwise it is checked here, and
+    // bytes that are not well-formed UTF-8 are encoded as single-byte tokens.
+    tt_stl::vector<int> encode_native(std::string_view line_to_encode,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated = false) const;
+    // encode_native for text that break_into_specials has already split.
+    tt_stl::vector<int> encode_segments(std::span<const std::string_view> segments,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated = false) const;
+    // encode_segments, appending to tokens.
+    void encode_segments(std::span<const std::string_view> segments,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated, tt_stl::vector<int> &tokens) const;
+    // Appends the tokens of one segment of break_into_specials, which is special or text as its position says.
+    void encode_segment(std::string_view segment, bool special, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+        bool utf8_validated, tt_stl::vector<int> &tokens) const;
+    // Cuts a text segment, which must be valid UTF-8, into pieces of about target_size bytes that encode on their own
+    // to the same tokens as the whole. The segment stays whole when the pattern has no hand-written pre-tokenizer.
+    [[nodiscard]] scratch_vector<std::string_view> split_segment(std::string_view segment, size_t target_size) const;
+    // Receives encoded tokens a block at a time, for callers that store them in their own format.
+    using TokenBlockCallback = void (*)(void *context, std::span<const int> block);
+    // encode_segments, handing the tokens to emit in blocks instead of storing them.
+    void encode_segments(std::span<const std::string_view> segments,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated, TokenBlockCallback emit,
+        void *context) const;
+    // encode_segments, also appending the range of line_to_encode every token stands for to offsets. segments must be
+    // views into line_to_encode, as break_into_specials returns them.
+    void encode_with_offsets(std::string_view line_to_encode, std::span<const std::string_view> segments,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated, tt_stl::vector<int> &tokens,
+        tt_stl::vector<ByteRange> &offsets) const;
+    // The number of tokens encode_native would return, without storing them.
+    [[nodiscard]] size_t count_native(std::string_view line_to_encode,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special, bool utf8_validated = false) const;
+    tt_stl::string decode_native(std::span<const int> input_tokens_to_decode) const;
+    // The bytes token_id decodes to, empty for an id the encoding does not have.
+    [[nodiscard]] std::span<const uint8_t> token_bytes(int token_id) const;
+    // The highest id a byte pair rank or special token has.
+    [[nodiscard]] int max_token_id() const;
+    [[nodiscard]] size_t decoded_size(std::span<const int> input_tokens_to_decode) const;
+    // Writes the decoded bytes to out, which must have room for decoded_size of them.
+    void decode_into(std::span<const int> input_tokens_to_decode, char *out) const;
+    // Splits into text, special token, text, ..., text, where every second segment is a special token whether it is
+    // allowed or not. Where special tokens overlap, the leftmost (then longest) one wins.
+    // The segments come from scratch_memory_resource(). A caller that knows no special token starts before
+    // search_from can have the search begin there.
+    scratch_vector<std::string_view> break_into_specials(std::string_view line_to_encode,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special, size_t search_from = 0) const;
+    // Whether break_into_specials would return more than one segment.
+    [[nodiscard]] bool contains_special(std::string_view line_to_encode,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special) const;
+
+    // Keeps the tokens of up to capacity pieces that are not tokens themselves, so that frequent ones are merged
+    // once. 0 turns the cache off, which is the default. Must not race with encoding.
+    void set_piece_cache_capacity(size_t capacity);
+    [[nodiscard]] PieceCacheStats piece_cache_stats() const;
 
-    [[nodiscard]] const bpe_encoding_t& getBytePairRanks() const { return byte_pair_ranks_; }
+    [[nodiscard]] const bpe_encoding_t& getBytePairRanks() const;
+    [[nodiscard]] const RankTable& getRankTable() const { return rank_table_; }
+    [[nodiscard]] const SpecialTokenMatcher& getSpecialTokenMatcher() const { return special_token_matcher_; }
+    [[nodiscard]] PreTokenizerPattern getPreTokenizer() const { return pre_tokenizer_; }
     [[nodiscard]] const tt_stl::unordered_map<tt_stl::string, int>& getSpecialTokenMappings() const { return special_token_mappings_; }
 };
 }
\ No newline at end of file
@@ -1,10 +1,18 @@
 function(tiktoken_embed_resource RSRC_FILE RESOURCE_NAME RETVAL_VAR)
-    set(MSVC_STRING_LITERAL_LEN_LIMIT 16380)
+    # MSVC limits the length of a string literal, so it gets the vocabulary as an array of words instead.
+    if (MSVC)
+        set(EMBED_FORMAT array)
+    else()
+        set(EMBED_FORMAT string)
+    endif()
 
-    set(OUT_CPP_FILE "${CMAKE_BINARY_DIR}/resources/resource_${RESOURCE_NAME}.cpp")
+    set(OUT_DIR "${PROJECT_BINARY_DIR}/resources")
+    set(OUT_CPP_FILE "${OUT_DIR}/resource_${RESOURCE_NAME}.cpp")
+    file(MAKE_DIRECTORY "${OUT_DIR}")
     add_custom_command(OUTPUT ${OUT_CPP_FILE}
-        COMMAND "${Python3_EXECUTABLE}" "${CMAKE_SOURCE_DIR}/tools/file2cpp.py" "${RSRC_FILE}" "${OUT_CPP_FILE}" resource_${RESOURCE_NAME}
+        COMMAND "${Python3_EXECUTABLE}" "${PROJECT_SOURCE_DIR}/tools/vocab2cpp.py" "${RSRC_FILE}" "${OUT_CPP_FILE}" resource_${RESOURCE_NAME} ${EMBED_FORMAT}
+        DEPENDS "${RSRC_FILE}" "${PROJECT_SOURCE_DIR}/tools/vocab2cpp.py" "${PROJECT_SOURCE_DIR}/tools/tiktoken_to_binary.py"
         COMMENT "Embedding resource ${RSRC_FILE}..."
     )
     set(${RETVAL_VAR} "${OUT_CPP_FILE}" PARENT_SCOPE) # retval
-endfunction()
\ No newline at end of file
+endfunction()
@@ -1,6 +1,10 @@
 #pragma once
 
 #define TIKTOKEN_EXCEPTIONS_ENABLE 0
+// 1 collects EncodeStats. At 0, the default, the counters and timers are compiled out.
+#ifndef TIKTOKEN_STATS_ENABLE
+#define TIKTOKEN_STATS_ENABLE 0
+#endif
 
 #ifndef TIKTOKEN_STL_TYPEDEFS_DEFINED
 #include <string>
@@ -8,6 +12,10 @@
 #include <unordered_set>
 #include <vector>
 #endif
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <span>
 #include <string_view>
 
 namespace tiktoken
@@ -25,20 +33,38 @@ namespace tt_stl
     using vector = std::vector<T>;
     template <typename T>
     using unordered_set = std::unordered_set<T>;
-    template<typename K, typename V, typename H = std::hash<K>>
-    using unordered_map = std::unordered_map<K, V, H>;
+    template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K>>
+    using unordered_map = std::unordered_map<K, V, H, E>;
 }
 #endif // TIKTOKEN_STL_TYPEDEFS_DEFINED
 
+// Hash and equality are transparent so ranks can be looked up by a span into the text being encoded,
+// without building a vector key for every lookup.
 struct bpe_encoding_hash_t
 {
-    std::size_t operator()(const tt_stl::vector<uint8_t> &v) const
+    using is_transparent = void;
+
+    std::size_t operator()(std::span<const uint8_t> v) const
     {
         const char *const begin = reinterpret_cast<const char *>(v.data());
         return std::hash<std::string_view> {}(std::string_view(begin, v.size()));
     }
+    std::size_t operator()(const tt_stl::vector<uint8_t> &v) const
+    {
+        return (*this)(std::span<const uint8_t>(v.data(), v.size()));
+    }
+};
+
+struct bpe_encoding_equal_t
+{
+    using is_transparent = void;
+
+    bool operator()(std::span<const uint8_t> a, std::span<const uint8_t> b) const
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end());
+    }
 };
 
-using bpe_encoding_t = tt_stl::unordered_map<tt_stl::vector<uint8_t>, int, bpe_encoding_hash_t>;
+using bpe_encoding_t = tt_stl::unordered_map<tt_stl::vector<uint8_t>, int, bpe_encoding_hash_t, bpe_encoding_equal_t>;
 
 }
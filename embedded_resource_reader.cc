@@ -16,9 +16,12 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "embedded_resource_reader.h"
+#include "binary_vocabulary.h"
 #include "encoding_utils.h"
+#include "thread_pool.h"
 
-#include <cstdlib>
+#include <algorithm>
+#include <charconv>
 #include <stdexcept>
 
 #ifndef TIKTOKEN_EMBEDDED_RESOURCES
@@ -30,9 +33,6 @@
 #include <limits.h>
 #include <unistd.h>
 #endif
-#else
-#include <streambuf>
-#include <istream>
 #endif
 
 #if defined(TIKTOKEN_EMBEDDED_RESOURCES)
@@ -65,16 +65,12 @@ namespace
     static const std::filesystem::path g_exe_parent_path = get_exe_parent_path_intern();
 #endif
 
-    class EmbeddedResourceReader: public IResourceReader {
-    public:
-        tt_stl::vector<tt_stl::string> readLines(std::string_view resourceName) override;
-    };
-
-    tt_stl::vector<tt_stl::string> EmbeddedResourceReader::readLines(std::string_view resourceName)
+    // The whole of the resource file, or an empty string if there is none.
+    tt_stl::string read_resource_file(std::string_view resourceName)
     {
 #ifndef TIKTOKEN_EMBEDDED_RESOURCES
         std::filesystem::path resource_path = g_exe_parent_path / "tokenizers" / resourceName;
-        std::ifstream file(resource_path);
+        std::ifstream file(resource_path, std::ios::binary);
         if (!file.is_open()) {
 #if TIKTOKEN_EXCEPTIONS_ENABLE
             throw std::runtime_error("Embedded resource '" + resource_path.string() + "' not found.");
@@ -83,60 +79,125 @@ namespace
 #endif
         }
 
-        tt_stl::string line;
-        tt_stl::vector<tt_stl::string> lines;
-        while (tt_stl::getline(file, line)) {
-            lines.push_back(line);
+        file.seekg(0, std::ios::end);
+        const auto size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        tt_stl::string contents(size > 0 ? static_cast<size_t>(size) : 0, '\0');
+        file.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+        contents.resize(static_cast<size_t>(file.gcount()));
+        return contents;
+#else
+        // Only vocabularies are compiled in, and get_embedded_vocabulary serves them without going through lines.
+        (void) resourceName;
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+        throw std::runtime_error("Embedded resource '" + (tt_stl::string) resourceName + "' not found.");
+#else
+        return {};
+#endif
+#endif
+    }
+
+    // Adds the "<base64 bytes> <rank>" on line to builder, decoding through scratch. Lines without a rank are
+    // skipped.
+    void parse_vocabulary_line(std::string_view line, RankTable::Builder &builder, tt_stl::vector<uint8_t> &scratch)
+    {
+        const auto is_whitespace = [](char c) { return c == ' ' || (c >= '\t' && c <= '\r'); };
+
+        size_t b64str_end_offset = 0;
+        while (b64str_end_offset < line.size() && !is_whitespace(line[b64str_end_offset])) {
+            ++b64str_end_offset;
+        }
+        size_t rank_offset = b64str_end_offset;
+        while (rank_offset < line.size() && is_whitespace(line[rank_offset])) {
+            ++rank_offset;
+        }
+        if (rank_offset == line.size()) {
+            return;
         }
 
-        return lines;
-#else
-        auto readLinesFromMem = [](std::pair<const unsigned char *, size_t> mem) {
-            struct membuf: std::streambuf {
-                membuf(char *base, std::ptrdiff_t n)
-                {
-                    this->setg(base, base, base + n);
-                }
-            };
+        int rank = 0;
+        if (std::from_chars(line.data() + rank_offset, line.data() + line.size(), rank).ec != std::errc()) {
+            return;
+        }
+        const auto b64str = line.substr(0, b64str_end_offset);
+        if (scratch.size() < base64::decoded_size_bound(b64str.size())) {
+            scratch.resize(base64::decoded_size_bound(b64str.size()));
+        }
+        builder.add({ scratch.data(), base64::decode_into(b64str, scratch.data()) }, rank);
+    }
 
-            membuf sbuf(const_cast<char *>((const char*) mem.first), (ptrdiff_t) mem.second);
-            std::istream file(&sbuf);
+    // Adds every line of text to builder.
+    void parse_vocabulary(std::string_view text, RankTable::Builder &builder)
+    {
+        // Lines of the published vocabularies average about 16 characters, of which 8 are base64
+        builder.reserve(text.size() / 16, base64::decoded_size_bound(text.size()) / 2);
+        tt_stl::vector<uint8_t> scratch;
+        for (size_t begin = 0; begin < text.size();) {
+            const size_t end = std::min(text.find('\n', begin), text.size());
+            parse_vocabulary_line(text.substr(begin, end - begin), builder, scratch);
+            begin = end + 1;
+        }
+    }
 
-            tt_stl::string line;
-            tt_stl::vector<tt_stl::string> lines;
-            while (tt_stl::getline(file, line))
-                lines.push_back(line);
+    // Text below this size is parsed by the calling thread alone.
+    constexpr size_t min_parse_chunk_size = 256 * 1024;
 
-            return lines;
-        };
+    // Parses a whole vocabulary file. Large files are cut into chunks at line breaks and the chunks parsed on the
+    // shared pool, each into its own builder; the builders are then joined in file order, which keeps the
+    // first-one-wins rule of RankTable::Builder, and the index is built with the pool's help.
+    RankTable parse_vocabulary_file(std::string_view text)
+    {
+        tt_stl::vector<std::string_view> chunks;
+        IExecutor *executor = nullptr;
+        if (text.size() >= 2 * min_parse_chunk_size) {
+            executor = &ThreadPool::shared();
+            const size_t chunk_count = std::min(executor->concurrency(), text.size() / min_parse_chunk_size);
+            for (size_t begin = 0, chunk = 1; begin < text.size(); ++chunk) {
+                size_t end = text.size();
+                if (chunk < chunk_count) {
+                    end = std::min(text.find('\n', std::max(begin, text.size() / chunk_count * chunk)), text.size());
+                }
+                chunks.push_back(text.substr(begin, end - begin));
+                begin = end + 1;
+            }
+        }
 
-        if (resourceName == "o200k_base.tiktoken")
-        {
-            return readLinesFromMem(get_resource_o200k_base());
+        tt_stl::vector<RankTable::Builder> builders(std::max<size_t>(1, chunks.size()));
+        if (chunks.size() > 1) {
+            executor->run(chunks.size(), [&](size_t chunk) { parse_vocabulary(chunks[chunk], builders[chunk]); });
+        } else {
+            parse_vocabulary(text, builders[0]);
         }
-        else if (resourceName == "cl100k_base.tiktoken") 
-        {
-            return readLinesFromMem(get_resource_cl100k_base());
+
+        if (builders.size() == 1) {
+            return builders[0].build(executor);
         }
-        else if (resourceName == "r50k_base.tiktoken") 
-        {
-            return readLinesFromMem(get_resource_r50k_base());
+        RankTable::Builder token_byte_pair_encoding;
+        for (auto &builder: builders) {
+            token_byte_pair_encoding.append(std::move(builder));
         }
-        else if (resourceName == "p50k_base.tiktoken") 
-        {
-            return readLinesFromMem(get_resource_p50k_base());
-        } 
-        else
-        {
-#if TIKTOKEN_EXCEPTIONS_ENABLE
-            throw std::runtime_error("Embedded resource '" + (tt_stl::string) resourceName + "' not found.");
+        return token_byte_pair_encoding.build(executor);
+    }
+}
+
+std::span<const uint8_t> get_embedded_vocabulary(std::string_view resource_name)
+{
+#if defined(TIKTOKEN_EMBEDDED_RESOURCES)
+    std::pair<const unsigned char *, size_t> resource { nullptr, 0 };
+    if (resource_name == "o200k_base.tiktoken") {
+        resource = get_resource_o200k_base();
+    } else if (resource_name == "cl100k_base.tiktoken") {
+        resource = get_resource_cl100k_base();
+    } else if (resource_name == "r50k_base.tiktoken") {
+        resource = get_resource_r50k_base();
+    } else if (resource_name == "p50k_base.tiktoken") {
+        resource = get_resource_p50k_base();
+    }
+    return { resource.first, resource.second };
 #else
-            return {};
+    (void) resource_name;
+    return {};
 #endif
-        }
-        
-#endif
-    }
 }
 
 EmbeddedResourceLoader::EmbeddedResourceLoader(const tt_stl::string& dataSourceName, IResourceReader* reader)
@@ -145,33 +206,35 @@ EmbeddedResourceLoader::EmbeddedResourceLoader(const tt_stl::string& dataSourceN
 {
 }
 
-tt_stl::vector<tt_stl::string> EmbeddedResourceLoader::readEmbeddedResourceAsLines() {
-    if (!!resourceReader_) {
-        return resourceReader_->readLines(dataSourceName_);
-    }
-    return EmbeddedResourceReader().readLines(dataSourceName_);
-}
-
 bpe_encoding_t
 EmbeddedResourceLoader::loadTokenBytePairEncoding()
 {
-    auto lines = readEmbeddedResourceAsLines();
-    bpe_encoding_t token_byte_pair_encoding;
+    return loadRankTable().to_map();
+}
 
-    for (const auto &line: lines) {
-        if (!line.empty()) {
-            const char* whitespace_chars = " \f\n\r\t\v";
+RankTable
+EmbeddedResourceLoader::loadRankTable()
+{
+    if (!resourceReader_) {
+        // A compiled-in vocabulary is already decoded and indexed, so it is used where it is.
+        const auto image = get_embedded_vocabulary(dataSourceName_);
+        if (!image.empty()) {
+            return BinaryVocabulary::from_image(image, nullptr, true).ranks;
+        }
+        // A file is read whole and parsed in place, without copying it line by line.
+        return parse_vocabulary_file(read_resource_file(dataSourceName_));
+    }
 
-            const size_t b64str_end_offset = line.find_first_of(whitespace_chars);
-            const size_t rank_offset = line.find_first_not_of(whitespace_chars, b64str_end_offset);
+    const auto lines = resourceReader_->readLines(dataSourceName_);
 
-            const auto decoded = base64::decode(std::string_view(line.c_str(), b64str_end_offset));
-            const int rank = std::strtol(line.c_str() + rank_offset, nullptr, 10);
-            token_byte_pair_encoding.insert({std::move(decoded), rank});
-        }
+    RankTable::Builder token_byte_pair_encoding;
+    token_byte_pair_encoding.reserve(lines.size(), lines.size() * 8);
+    tt_stl::vector<uint8_t> scratch;
+    for (const auto &line: lines) {
+        parse_vocabulary_line(line, token_byte_pair_encoding, scratch);
     }
 
-    return token_byte_pair_encoding;
+    return token_byte_pair_encoding.build();
 }
 
-}
\ No newline at end of file
+}
@@ -18,6 +18,8 @@
 #pragma once
 
 #include "common.h"
+#include "rank_table.h"
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -30,6 +32,9 @@ public:
     virtual tt_stl::vector<tt_stl::string> readLines(std::string_view resourceName) = 0;
 };
 
+// The binary vocabulary image compiled in for resource_name with CPP_TIKTOKEN_EMBED_RESOURCES, or an empty span.
+std::span<const uint8_t> get_embedded_vocabulary(std::string_view resource_name);
+
 class EmbeddedResourceLoader {
 public:
     explicit EmbeddedResourceLoader(
@@ -37,11 +42,11 @@ public:
         IResourceReader* reader = nullptr
     );
     
+    // The vocabulary as a map from token bytes to rank, as it was loaded before RankTable.
     bpe_encoding_t loadTokenBytePairEncoding();
+    RankTable loadRankTable();
 
 private:
-    tt_stl::vector<tt_stl::string> readEmbeddedResourceAsLines();
-
     IResourceReader* resourceReader_;
     tt_stl::string dataSourceName_;
 };
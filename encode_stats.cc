@@ -0,0 +1,111 @@
+#include "encode_stats.h"
+
+#if TIKTOKEN_STATS_ENABLE
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace tiktoken
+{
+
+#if TIKTOKEN_STATS_ENABLE
+namespace encode_stats_detail
+{
+    namespace
+    {
+        struct registry_t {
+            std::mutex mutex;
+            std::vector<thread_counters_t *> threads;
+            // Counts of threads that have exited.
+            uint64_t retired[counter_count] = {};
+            // Counts at the last reset, which reads subtract.
+            uint64_t baseline[counter_count] = {};
+        };
+
+        registry_t &registry()
+        {
+            // Never destroyed, so threads that exit during static destruction can still hand in their counts
+            static registry_t *const instance = new registry_t;
+            return *instance;
+        }
+
+        // The counts of every thread so far. The registry mutex must be held.
+        void total_counts(registry_t &threads, uint64_t (&total)[counter_count])
+        {
+            for (size_t i = 0; i < counter_count; ++i) {
+                total[i] = threads.retired[i];
+            }
+            for (const auto *counters: threads.threads) {
+                for (size_t i = 0; i < counter_count; ++i) {
+                    total[i] += counters->values[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    thread_counters_t::thread_counters_t()
+    {
+        auto &threads = registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        threads.threads.push_back(this);
+    }
+
+    thread_counters_t::~thread_counters_t()
+    {
+        auto &threads = registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        for (size_t i = 0; i < counter_count; ++i) {
+            threads.retired[i] += values[i].load(std::memory_order_relaxed);
+        }
+        threads.threads.erase(std::find(threads.threads.begin(), threads.threads.end(), this));
+    }
+
+    thread_counters_t &thread_counters()
+    {
+        thread_local thread_counters_t counters;
+        return counters;
+    }
+}
+#endif
+
+EncodeStats encode_stats()
+{
+    EncodeStats stats;
+#if TIKTOKEN_STATS_ENABLE
+    using namespace encode_stats_detail;
+    uint64_t total[counter_count];
+    {
+        auto &threads = registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        total_counts(threads, total);
+        for (size_t i = 0; i < counter_count; ++i) {
+            total[i] -= threads.baseline[i];
+        }
+    }
+    stats.bytes_in = total[counter_t::bytes_in];
+    stats.pieces = total[counter_t::pieces];
+    stats.tokens = total[counter_t::tokens];
+    stats.merge_iterations = total[counter_t::merge_iterations];
+    stats.allocations = total[counter_t::allocations];
+    for (size_t i = 0; i < stats.piece_lengths.size(); ++i) {
+        stats.piece_lengths[i] = total[counter_t::piece_lengths + i];
+    }
+    for (size_t i = 0; i < stats.stage_nanoseconds.size(); ++i) {
+        stats.stage_nanoseconds[i] = total[counter_t::stage_nanoseconds + i];
+    }
+#endif
+    return stats;
+}
+
+void reset_encode_stats()
+{
+#if TIKTOKEN_STATS_ENABLE
+    using namespace encode_stats_detail;
+    auto &threads = registry();
+    std::lock_guard<std::mutex> lock(threads.mutex);
+    total_counts(threads, threads.baseline);
+#endif
+}
+
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "common.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#if TIKTOKEN_STATS_ENABLE
+#include <atomic>
+#include <chrono>
+#endif
+
+namespace tiktoken
+{
+
+// The stages of an encode that EncodeStats times.
+enum class EncodeStage {
+    SpecialTokens,  // finding special tokens and splitting the text around them
+    Utf8Validation, // checking the text for ill-formed UTF-8
+    PreTokenize,    // cutting text into pieces, by the hand-written pre-tokenizer or the regex
+    Merge,          // turning pieces into tokens: rank lookups, byte_pair_merge and the piece cache
+    COUNT
+};
+
+// What encoding has done in this process since it started or since the last reset_encode_stats, summed over every
+// thread. Only a library built with TIKTOKEN_STATS_ENABLE set collects it; otherwise every field stays 0 and
+// collecting costs nothing.
+struct EncodeStats {
+    static constexpr bool enabled = TIKTOKEN_STATS_ENABLE != 0;
+    // Bucket 0 counts pieces of one byte, bucket i those of 2^(i-1) + 1 to 2^i bytes, and the last also every longer
+    // piece.
+    static constexpr size_t piece_length_buckets = 16;
+    static constexpr uint32_t merge_sample_interval = 16;
+
+    // Bytes of text encoded, special tokens included.
+    uint64_t bytes_in = 0;
+    uint64_t pieces = 0;
+    uint64_t tokens = 0;
+    // Pairs byte_pair_merge merged, which is what makes long pieces slow.
+    uint64_t merge_iterations = 0;
+    // Times a token buffer or the merge scratch had to grow.
+    uint64_t allocations = 0;
+    std::array<uint64_t, piece_length_buckets> piece_lengths {};
+    // Wall time spent in each stage. Timing every piece would cost more than the pieces do, so the split between
+    // PreTokenize and Merge is estimated by timing the merge of one piece in merge_sample_interval.
+    std::array<uint64_t, static_cast<size_t>(EncodeStage::COUNT)> stage_nanoseconds {};
+
+    [[nodiscard]] uint64_t nanoseconds(EncodeStage stage) const { return stage_nanoseconds[static_cast<size_t>(stage)]; }
+};
+
+EncodeStats encode_stats();
+// Starts counting from 0 again. Encodes running at the same time may be counted on either side of the reset.
+void reset_encode_stats();
+
+// The recording side, called from the encoding pipeline. Without TIKTOKEN_STATS_ENABLE every call is empty.
+namespace encode_stats_detail
+{
+#if TIKTOKEN_STATS_ENABLE
+    enum counter_t : size_t {
+        bytes_in,
+        pieces,
+        tokens,
+        merge_iterations,
+        allocations,
+        piece_lengths,
+        stage_nanoseconds = piece_lengths + EncodeStats::piece_length_buckets,
+        counter_count = stage_nanoseconds + static_cast<size_t>(EncodeStage::COUNT)
+    };
+
+    // The counters of one thread. Only that thread writes them, so adding is a plain load and store; other threads
+    // read them when stats are taken.
+    struct thread_counters_t {
+        thread_counters_t();
+        ~thread_counters_t();
+
+        void add(size_t counter, uint64_t amount)
+        {
+            values[counter].store(values[counter].load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        std::atomic<uint64_t> values[counter_count] {};
+        uint32_t merges_until_sample = 0;
+    };
+
+    thread_counters_t &thread_counters();
+
+    inline uint64_t now()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+#endif
+
+    inline void count_bytes_in(size_t bytes)
+    {
+#if TIKTOKEN_STATS_ENABLE
+        thread_counters().add(counter_t::bytes_in, bytes);
+#else
+        (void) bytes;
+#endif
+    }
+
+    inline void count_piece(size_t length)
+    {
+#if TIKTOKEN_STATS_ENABLE
+        size_t bucket = 0;
+        while (bucket + 1 < EncodeStats::piece_length_buckets && (size_t(1) << bucket) < length) {
+            ++bucket;
+        }
+        auto &counters = thread_counters();
+        counters.add(counter_t::pieces, 1);
+        counters.add(counter_t::piece_lengths + bucket, 1);
+#else
+        (void) length;
+#endif
+    }
+
+    inline void count_token()
+    {
+#if TIKTOKEN_STATS_ENABLE
+        thread_counters().add(counter_t::tokens, 1);
+#endif
+    }
+
+    inline void count_merges(size_t merges)
+    {
+#if TIKTOKEN_STATS_ENABLE
+        thread_counters().add(counter_t::merge_iterations, merges);
+#else
+        (void) merges;
+#endif
+    }
+
+    // Counts an allocation if buffer has to grow to hold size elements.
+    template <typename Buffer>
+    inline void count_growth(const Buffer &buffer, size_t size)
+    {
+#if TIKTOKEN_STATS_ENABLE
+        if (size > buffer.capacity()) {
+            thread_counters().add(counter_t::allocations, 1);
+        }
+#else
+        (void) buffer;
+        (void) size;
+#endif
+    }
+
+    // Adds the time from construction to destruction to stage.
+    class StageTimer {
+    public:
+        explicit StageTimer(EncodeStage stage)
+#if TIKTOKEN_STATS_ENABLE
+            : stage_(stage), start_(now())
+#endif
+        {
+            (void) stage;
+        }
+        ~StageTimer()
+        {
+#if TIKTOKEN_STATS_ENABLE
+            thread_counters().add(counter_t::stage_nanoseconds + static_cast<size_t>(stage_), now() - start_);
+#endif
+        }
+
+        StageTimer(const StageTimer &) = delete;
+        StageTimer &operator=(const StageTimer &) = delete;
+
+#if TIKTOKEN_STATS_ENABLE
+    private:
+        EncodeStage stage_;
+        uint64_t start_;
+#endif
+    };
+
+    // Times a run of pre-tokenizing text and merging its pieces, which interleave piece by piece. merge runs the
+    // merging of one piece and times a sample of them; what the sample leaves of the whole run is pre-tokenizing.
+    class PieceTimer {
+    public:
+        PieceTimer()
+#if TIKTOKEN_STATS_ENABLE
+            : start_(now())
+#endif
+        { }
+        ~PieceTimer()
+        {
+#if TIKTOKEN_STATS_ENABLE
+            const uint64_t total = now() - start_;
+            auto &counters = thread_counters();
+            counters.add(counter_t::stage_nanoseconds + static_cast<size_t>(EncodeStage::Merge), merge_);
+            counters.add(counter_t::stage_nanoseconds + static_cast<size_t>(EncodeStage::PreTokenize),
+                total > merge_ ? total - merge_ : 0);
+#endif
+        }
+
+        template <typename Merge>
+        void merge(Merge &&merge_piece)
+        {
+#if TIKTOKEN_STATS_ENABLE
+            auto &counters = thread_counters();
+            if (counters.merges_until_sample == 0) {
+                counters.merges_until_sample = EncodeStats::merge_sample_interval - 1;
+                const uint64_t start = now();
+                merge_piece();
+                merge_ += (now() - start) * EncodeStats::merge_sample_interval;
+                return;
+            }
+            --counters.merges_until_sample;
+#endif
+            merge_piece();
+        }
+
+        PieceTimer(const PieceTimer &) = delete;
+        PieceTimer &operator=(const PieceTimer &) = delete;
+
+#if TIKTOKEN_STATS_ENABLE
+    private:
+        uint64_t start_;
+        uint64_t merge_ = 0;
+#endif
+    };
+}
+
+}
@@ -16,9 +16,17 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "encoding.h"
+#include "encode_stats.h"
+#include "encoding_utils.h"
+#include "binary_vocabulary.h"
 #include "modelparams.h"
 #include "pcre2_regex.h"
+#include "scratch_memory.h"
+#include "streaming_encoder.h"
+#include "thread_pool.h"
 
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 #define PCRE2_CODE_UNIT_WIDTH 0
 #include <pcre2.h>
@@ -26,11 +34,20 @@
 namespace tiktoken
 {
 
-GptEncoding::GptEncoding(tt_stl::string&& pattern_string, bpe_encoding_t&& byte_pair_ranks,
+namespace
+{
+    bool has_invalid_utf8(std::string_view text)
+    {
+        encode_stats_detail::StageTimer timer(EncodeStage::Utf8Validation);
+        return utf8::find_invalid(text) != std::string_view::npos;
+    }
+}
+
+GptEncoding::GptEncoding(tt_stl::string&& pattern_string, RankTable&& rank_table,
     tt_stl::unordered_map<tt_stl::string, int>&& special_token_mappings, int explicit_n_vocab) :
     n_words(explicit_n_vocab),
-    byte_pair_encoding_core_processor_(std::move(byte_pair_ranks), std::move(special_token_mappings),
-        PCRERegex(pattern_string, PCRE2_CASELESS)) { }
+    byte_pair_encoding_core_processor_(std::move(rank_table), std::move(special_token_mappings),
+        PCRERegex(pattern_string, PCRE2_CASELESS), find_pre_tokenizer_pattern(pattern_string)) { }
 
 GptEncoding GptEncoding::get_encoding(ModelParams &&params)
 {
@@ -41,7 +58,7 @@ GptEncoding GptEncoding::get_encoding(ModelParams &&params)
 GptEncoding GptEncoding::get_encoding_llama3(ModelParams &&params)
 {
     const int num_reserved_special_tokens = 256;
-    const int num_base_tokens = (int) params.mergeable_ranks.size();
+    const int num_base_tokens = (int) params.mergeable_ranks.token_count();
 
     tt_stl::unordered_map<tt_stl::string, int> special_llama3_token_mappings;
     tt_stl::vector<tt_stl::string> list_special_tokens = { "<|begin_of_text|>",
@@ -68,7 +85,7 @@ GptEncoding GptEncoding::get_encoding_llama3(ModelParams &&params)
 GptEncoding GptEncoding::get_encoding_llama3_1(ModelParams &&params)
 {
     const int num_reserved_special_tokens = 256;
-    const int num_base_tokens = (int) params.mergeable_ranks.size();
+    const int num_base_tokens = (int) params.mergeable_ranks.token_count();
 
     tt_stl::unordered_map<tt_stl::string, int> special_llama3_token_mappings;
     tt_stl::vector<tt_stl::string> list_special_tokens = { "<|begin_of_text|>",
@@ -118,31 +135,489 @@ GptEncoding GptEncoding::get_encoding_llama3_1(LanguageModel model, IResourceRea
     return get_encoding_llama3_1(std::move(model_params));
 }
 
-tt_stl::vector<int> GptEncoding::encode(const tt_stl::string &line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
-    const tt_stl::unordered_set<tt_stl::string> &disallowed_special)
+GptEncoding GptEncoding::get_encoding_from_binary(LanguageModel model, const tt_stl::string &path)
 {
-    // Check for disallowed special tokens
-    if (disallowed_special.count("all") > 0) {
-        for (const auto &special_token: byte_pair_encoding_core_processor_.getSpecialTokenMappings()) {
-            if (line_to_encode.find(special_token.first) != tt_stl::string::npos) {
+    return get_encoding(model, BinaryVocabulary::map_file(path));
+}
+
+GptEncoding GptEncoding::get_encoding(LanguageModel model, BinaryVocabulary &&vocabulary)
+{
+    const char *const pattern = ModelParamsGenerator::get_pattern(model);
+    if (!pattern) {
 #if TIKTOKEN_EXCEPTIONS_ENABLE
-                throw std::invalid_argument("Disallowed special token found: " + special_token.first);
+        throw std::runtime_error("Invalid argument to get_model_params");
 #else
-                return {};
+        return get_encoding(ModelParams());
 #endif
+    }
+    if (vocabulary.special_tokens.empty()) {
+        vocabulary.special_tokens = ModelParamsGenerator::get_special_tokens(model);
+    }
+    return GptEncoding(pattern, std::move(vocabulary.ranks),
+        std::move(vocabulary.special_tokens), ModelParamsGenerator::get_explicit_n_vocab(model));
+}
+
+bool GptEncoding::prepare_text(std::string_view line_to_encode,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special, bool split, std::pmr::string &replaced,
+    PreparedText &prepared) const
+{
+    const auto &core = byte_pair_encoding_core_processor_;
+    prepared.text = line_to_encode;
+    // One scan finds every special token, for the disallowed check and for splitting the text around them
+    if (split) {
+        prepared.segments = core.break_into_specials(line_to_encode, allowed_special);
+        if (disallowed_special.count("all") > 0 && prepared.segments.size() > 1) {
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+            throw std::invalid_argument("Disallowed special token found: " + tt_stl::string(prepared.segments[1]));
+#else
+            return false;
+#endif
+        }
+    } else if (disallowed_special.count("all") > 0 && core.contains_special(line_to_encode, allowed_special)) {
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+        throw std::invalid_argument("Disallowed special token found");
+#else
+        return false;
+#endif
+    }
+    // Validate the input once up front so the pre-tokenizer never has to re-check it
+    if (!has_invalid_utf8(line_to_encode)) {
+        return true;
+    }
+    switch (invalid_utf8_policy_) {
+        case InvalidUtf8Policy::ByteFallback:
+            prepared.utf8_validated = false;
+            return true;
+        case InvalidUtf8Policy::Replace:
+            replaced = utf8::replace_invalid(line_to_encode, replaced.get_allocator().resource());
+            prepared.text = replaced;
+            prepared.replaced = true;
+            if (split) {
+                prepared.segments = core.break_into_specials(replaced, allowed_special);
             }
+            return true;
+        case InvalidUtf8Policy::Reject:
+            break;
+    }
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+    throw std::invalid_argument("Input is not valid UTF-8");
+#else
+    return false;
+#endif
+}
+
+tt_stl::vector<int> GptEncoding::encode(const tt_stl::string &line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special) const
+{
+    tt_stl::vector<int> tokens;
+    encode_append(line_to_encode, allowed_special, disallowed_special, tokens);
+    return tokens;
+}
+
+void GptEncoding::encode_append(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special, tt_stl::vector<int> &tokens) const
+{
+    std::pmr::string replaced(scratch_memory_resource());
+    PreparedText prepared;
+    if (prepare_text(line_to_encode, allowed_special, disallowed_special, true, replaced, prepared)) {
+        byte_pair_encoding_core_processor_.encode_segments(prepared.segments, allowed_special, prepared.utf8_validated,
+            tokens);
+    }
+}
+
+void GptEncoding::encode_blocks(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special, BytePairEncodingCore::TokenBlockCallback emit,
+    void *context) const
+{
+    std::pmr::string replaced(scratch_memory_resource());
+    PreparedText prepared;
+    if (prepare_text(line_to_encode, allowed_special, disallowed_special, true, replaced, prepared)) {
+        byte_pair_encoding_core_processor_.encode_segments(prepared.segments, allowed_special, prepared.utf8_validated,
+            emit, context);
+    }
+}
+
+const tt_stl::unordered_set<tt_stl::string> &GptEncoding::all_special_tokens()
+{
+    static const tt_stl::unordered_set<tt_stl::string> all = { "all" };
+    return all;
+}
+
+size_t GptEncoding::count_tokens(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special) const
+{
+    // The same checks as encode, without keeping the segments
+    std::pmr::string replaced(scratch_memory_resource());
+    PreparedText prepared;
+    if (!prepare_text(line_to_encode, allowed_special, disallowed_special, false, replaced, prepared)) {
+        return 0;
+    }
+    return byte_pair_encoding_core_processor_.count_native(prepared.text, allowed_special, prepared.utf8_validated);
+}
+
+namespace
+{
+    // encode_prefix first takes about this many bytes per token of the budget, which covers most text in one go,
+    // and doubles the block each time that was not enough.
+    constexpr size_t prefix_bytes_per_token = 6;
+
+    // The length of the start of text that InvalidUtf8Policy::Replace turns into the first replaced_size bytes. A
+    // U+FFFD that replaced_size ends inside counts as the whole ill-formed subpart.
+    size_t input_size_before_replace(std::string_view text, size_t replaced_size)
+    {
+        size_t in = 0;
+        size_t out = 0;
+        while (out < replaced_size && in < text.size()) {
+            // A code point that starts inside the window ends within three bytes after it, so an ill-formed
+            // sequence found inside the window is not just cut short by it.
+            const size_t window = replaced_size - out;
+            const size_t invalid = utf8::find_invalid(text.substr(in, window + 3));
+            if (invalid == std::string_view::npos || invalid >= window) {
+                return std::min(in + window, text.size());
+            }
+            in += invalid;
+            out += invalid;
+            in += utf8::invalid_sequence_length(text.substr(in));
+            out += 3;
+        }
+        return in;
+    }
+}
+
+TokenPrefix GptEncoding::encode_prefix(std::string_view line_to_encode, size_t max_tokens,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special) const
+{
+    TokenPrefix prefix;
+    if (max_tokens == 0) {
+        return prefix;
+    }
+    // The streaming encoder hands out only tokens that the rest of the text cannot change, so they are the start
+    // of encode's tokens whichever block the text is cut at.
+    StreamingEncoder encoder(*this, allowed_special, disallowed_special);
+    const size_t size = line_to_encode.size();
+    size_t block = max_tokens < size / prefix_bytes_per_token ? max_tokens * prefix_bytes_per_token + 64 : size;
+    size_t pushed = 0;
+    while (prefix.tokens.size() < max_tokens) {
+        if (pushed == size) {
+            if (!encoder.finish(prefix.tokens)) {
+                return {};
+            }
+            break;
         }
+        const size_t length = std::min(block, size - pushed);
+        encoder.push(line_to_encode.substr(pushed, length), prefix.tokens);
+        if (encoder.failed()) {
+            return {};
+        }
+        pushed += length;
+        block = std::min(block * 2, size);
+    }
+    if (prefix.tokens.size() > max_tokens) {
+        prefix.tokens.resize(max_tokens);
     }
-    // Call the encode_native function from the BytePairEncodingCore class
-    return byte_pair_encoding_core_processor_.encode_native(line_to_encode, allowed_special).first;
+
+    prefix.offset = byte_pair_encoding_core_processor_.decoded_size(prefix.tokens);
+    if (invalid_utf8_policy_ == InvalidUtf8Policy::Replace) {
+        prefix.offset = input_size_before_replace(line_to_encode, prefix.offset);
+    }
+    return prefix;
+}
+
+bool GptEncoding::fits_within(std::string_view line_to_encode, size_t max_tokens,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special) const
+{
+    // One token past the budget settles it
+    const size_t budget = max_tokens < std::numeric_limits<size_t>::max() ? max_tokens + 1 : max_tokens;
+    return encode_prefix(line_to_encode, budget, allowed_special, disallowed_special).tokens.size() <= max_tokens;
 }
 
-tt_stl::string GptEncoding::decode(const tt_stl::vector<int> &input_tokens_to_decode)
+namespace
+{
+    // Turns offsets into the text utf8::replace_invalid makes of text into offsets into text itself. offsets must be
+    // in order, as encode gives them. A range that starts or ends inside a U+FFFD takes in the whole ill-formed
+    // subpart it replaced.
+    void map_replaced_offsets(std::string_view text, std::span<ByteRange> offsets)
+    {
+        struct subpart_t {
+            size_t replaced; // where its U+FFFD starts in the replaced text
+            size_t start;
+            size_t end;
+        };
+        constexpr size_t replacement_size = 3;
+        scratch_vector<subpart_t> subparts(scratch_memory_resource());
+        size_t in = 0;
+        size_t out = 0;
+        for (size_t invalid = utf8::find_invalid(text); invalid != std::string_view::npos;
+             invalid = utf8::find_invalid(text.substr(in))) {
+            in += invalid;
+            out += invalid;
+            const size_t length = utf8::invalid_sequence_length(text.substr(in));
+            subparts.push_back({ out, in, in + length });
+            in += length;
+            out += replacement_size;
+        }
+
+        // The subparts before next end at or before the offset being mapped
+        size_t next = 0;
+        auto map = [&subparts, &next](size_t offset, bool end) {
+            while (next < subparts.size() && subparts[next].replaced + replacement_size <= offset) {
+                ++next;
+            }
+            if (next < subparts.size() && subparts[next].replaced < offset) {
+                return end ? subparts[next].end : subparts[next].start;
+            }
+            return next == 0 ? offset : offset - (subparts[next - 1].replaced + replacement_size) + subparts[next - 1].end;
+        };
+        for (auto &range: offsets) {
+            range.start = map(range.start, false);
+            range.end = map(range.end, true);
+        }
+    }
+}
+
+void GptEncoding::encode_with_offsets(std::string_view line_to_encode, tt_stl::vector<int> &tokens,
+    tt_stl::vector<ByteRange> &offsets, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special) const
+{
+    tokens.clear();
+    offsets.clear();
+    std::pmr::string replaced(scratch_memory_resource());
+    PreparedText prepared;
+    if (!prepare_text(line_to_encode, allowed_special, disallowed_special, true, replaced, prepared)) {
+        return;
+    }
+    byte_pair_encoding_core_processor_.encode_with_offsets(prepared.text, prepared.segments, allowed_special,
+        prepared.utf8_validated, tokens, offsets);
+    if (prepared.replaced) {
+        map_replaced_offsets(line_to_encode, offsets);
+    }
+}
+
+tt_stl::string GptEncoding::decode(const tt_stl::vector<int> &input_tokens_to_decode) const
 {
     // Call the decode_native function from the BytePairEncodingCore class
     return byte_pair_encoding_core_processor_.decode_native(input_tokens_to_decode);
 }
 
+size_t GptEncoding::decoded_size(const tt_stl::vector<int> &input_tokens_to_decode) const
+{
+    return byte_pair_encoding_core_processor_.decoded_size(input_tokens_to_decode);
+}
+
+namespace
+{
+    // Splits items 0 to count - 1 into at most chunk_count runs of about equal total size, returning the first item
+    // of every run followed by count.
+    template <typename Size>
+    scratch_vector<size_t> split_evenly(size_t count, size_t chunk_count, Size &&size_of)
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += size_of(i) + 1;
+        }
+        scratch_vector<size_t> starts(1, 0, scratch_memory_resource());
+        size_t done = 0;
+        for (size_t i = 0; i < count; ++i) {
+            done += size_of(i) + 1;
+            if (i + 1 < count && done * chunk_count >= total * starts.size()) {
+                starts.push_back(i + 1);
+            }
+        }
+        starts.push_back(count);
+        return starts;
+    }
+
+    IExecutor &executor_or_shared(IExecutor *executor)
+    {
+        return executor ? *executor : ThreadPool::shared();
+    }
+
+    // A few tasks per thread, so threads that finish early have something to steal. A single thread has no one to
+    // balance against and takes the whole batch as one task.
+    size_t task_count_for(const IExecutor &executor)
+    {
+        const size_t concurrency = executor.concurrency();
+        return concurrency <= 1 ? 1 : concurrency * 4;
+    }
+
+    // Below this many bytes encode_parallel is not worth the hand-off to other threads.
+    constexpr size_t parallel_encode_threshold = 256 * 1024;
+    // The smallest piece of text encode_parallel gives a task of its own.
+    constexpr size_t parallel_encode_min_piece = 64 * 1024;
+}
+
+TokenBatch GptEncoding::encode_batch(std::span<const std::string_view> texts,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special, IExecutor *executor) const
+{
+    TokenBatch batch;
+    batch.offsets.assign(texts.size() + 1, 0);
+    if (texts.empty()) {
+        return batch;
+    }
+    IExecutor &runner = executor_or_shared(executor);
+    const auto starts = split_evenly(texts.size(), task_count_for(runner),
+        [&texts](size_t i) { return texts[i].size(); });
+    const size_t chunk_count = starts.size() - 1;
+
+    // Each run of documents is encoded into its own buffer, with offsets relative to that buffer, and then copied
+    // into place.
+    // Only the per-chunk lists come from scratch memory; the buffers in them are made on the threads that fill them.
+    scratch_vector<tt_stl::vector<int>> chunk_tokens(chunk_count, scratch_memory_resource());
+    runner.run(chunk_count, [&](size_t chunk) {
+        auto &tokens = chunk_tokens[chunk];
+        size_t bytes = 0;
+        for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+            bytes += texts[i].size();
+        }
+        // Typical text runs about four bytes per token; reserving for it saves most of the regrowth.
+        tokens.reserve(bytes / 4 + 16);
+        for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+            encode_append(texts[i], allowed_special, disallowed_special, tokens);
+            batch.offsets[i + 1] = tokens.size();
+        }
+    });
+
+    if (chunk_count == 1) {
+        batch.tokens = std::move(chunk_tokens[0]);
+        return batch;
+    }
+    scratch_vector<size_t> chunk_offsets(chunk_count + 1, 0, scratch_memory_resource());
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        chunk_offsets[chunk + 1] = chunk_offsets[chunk] + chunk_tokens[chunk].size();
+    }
+    batch.tokens.resize(chunk_offsets[chunk_count]);
+    runner.run(chunk_count, [&](size_t chunk) {
+        std::copy(chunk_tokens[chunk].begin(), chunk_tokens[chunk].end(), batch.tokens.begin() + chunk_offsets[chunk]);
+        for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+            batch.offsets[i + 1] += chunk_offsets[chunk];
+        }
+        tt_stl::vector<int>().swap(chunk_tokens[chunk]);
+    });
+    return batch;
+}
+
+TextBatch GptEncoding::decode_batch(std::span<const int> tokens, std::span<const size_t> offsets,
+    IExecutor *executor) const
+{
+    TextBatch batch;
+    bool valid = !offsets.empty() && offsets[0] == 0 && offsets.back() <= tokens.size();
+    for (size_t i = 1; valid && i < offsets.size(); ++i) {
+        valid = offsets[i - 1] <= offsets[i];
+    }
+    if (!valid) {
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+        throw std::invalid_argument("Batch offsets do not fit the tokens");
+#else
+        return batch;
+#endif
+    }
+
+    const size_t count = offsets.size() - 1;
+    batch.offsets.assign(count + 1, 0);
+    if (count == 0) {
+        return batch;
+    }
+    IExecutor &runner = executor_or_shared(executor);
+    const auto starts = split_evenly(count, task_count_for(runner),
+        [&offsets](size_t i) { return offsets[i + 1] - offsets[i]; });
+    const size_t chunk_count = starts.size() - 1;
+    const auto document = [&](size_t i) { return tokens.subspan(offsets[i], offsets[i + 1] - offsets[i]); };
+
+    // The decoded sizes fix where every document goes, so the second pass decodes straight into place.
+    runner.run(chunk_count, [&](size_t chunk) {
+        for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+            batch.offsets[i + 1] = byte_pair_encoding_core_processor_.decoded_size(document(i));
+        }
+    });
+    for (size_t i = 0; i < count; ++i) {
+        batch.offsets[i + 1] += batch.offsets[i];
+    }
+    batch.text.resize(batch.offsets[count]);
+    runner.run(chunk_count, [&](size_t chunk) {
+        for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+            byte_pair_encoding_core_processor_.decode_into(document(i), batch.text.data() + batch.offsets[i]);
+        }
+    });
+    return batch;
+}
+
+tt_stl::vector<int> GptEncoding::encode_parallel(std::string_view line_to_encode,
+    const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+    const tt_stl::unordered_set<tt_stl::string> &disallowed_special, IExecutor *executor) const
+{
+    tt_stl::vector<int> tokens;
+    IExecutor &runner = executor_or_shared(executor);
+    const size_t task_count = task_count_for(runner);
+    if (task_count == 1 || line_to_encode.size() < parallel_encode_threshold) {
+        encode_append(line_to_encode, allowed_special, disallowed_special, tokens);
+        return tokens;
+    }
+
+    std::pmr::string replaced(scratch_memory_resource());
+    PreparedText prepared;
+    if (!prepare_text(line_to_encode, allowed_special, disallowed_special, true, replaced, prepared)) {
+        return tokens;
+    }
+    const auto &segments = prepared.segments;
+    if (!prepared.utf8_validated) {
+        // Safe cut points are only known for valid text, so this input is encoded on one thread.
+        byte_pair_encoding_core_processor_.encode_segments(segments, allowed_special, false, tokens);
+        return tokens;
+    }
+
+    // Text segments are cut where pre-tokenization restarts cleanly, so no piece crosses a cut and the pieces encode
+    // independently. Special segments stay whole.
+    struct unit_t {
+        std::string_view text;
+        bool special;
+    };
+    const size_t target_size = std::max(parallel_encode_min_piece, line_to_encode.size() / task_count);
+    scratch_vector<unit_t> units(scratch_memory_resource());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (i % 2 == 1) {
+            units.push_back({ segments[i], true });
+            continue;
+        }
+        for (const auto piece: byte_pair_encoding_core_processor_.split_segment(segments[i], target_size)) {
+            units.push_back({ piece, false });
+        }
+    }
+    if (units.size() == 1) {
+        byte_pair_encoding_core_processor_.encode_segment(units[0].text, false, allowed_special, true, tokens);
+        return tokens;
+    }
+
+    const auto starts = split_evenly(units.size(), task_count, [&units](size_t i) { return units[i].text.size(); });
+    const size_t chunk_count = starts.size() - 1;
+    scratch_vector<tt_stl::vector<int>> chunk_tokens(chunk_count, scratch_memory_resource());
+    runner.run(chunk_count, [&](size_t chunk) {
+        auto &out = chunk_tokens[chunk];
+        size_t bytes = 0;
+        for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+            bytes += units[i].text.size();
+        }
+        out.reserve(bytes / 4 + 16);
+        for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+            byte_pair_encoding_core_processor_.encode_segment(units[i].text, units[i].special, allowed_special, true, out);
+        }
+    });
+
+    scratch_vector<size_t> chunk_offsets(chunk_count + 1, 0, scratch_memory_resource());
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        chunk_offsets[chunk + 1] = chunk_offsets[chunk] + chunk_tokens[chunk].size();
+    }
+    tokens.resize(chunk_offsets[chunk_count]);
+    runner.run(chunk_count, [&](size_t chunk) {
+        std::copy(chunk_tokens[chunk].begin(), chunk_tokens[chunk].end(), tokens.begin() + chunk_offsets[chunk]);
+        tt_stl::vector<int>().swap(chunk_tokens[chunk]);
+    });
+    return tokens;
+}
+
 const bpe_encoding_t &GptEncoding::get_byte_pair_token_map() const
 {
     return byte_pair_encoding_core_processor_.getBytePairRanks();
@@ -18,24 +18,139 @@
 #pragma once
 #include "common.h"
 #include "byte_pair_encoding.h"
+#include "encode_stats.h"
 #include "modelparams.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace tiktoken
 {
 
+class BinaryVocabulary;
+class IExecutor;
 class IResourceReader;
 
+// How encode treats input that is not well-formed UTF-8.
+enum class InvalidUtf8Policy {
+    ByteFallback, // ill-formed bytes become single-byte tokens, so decode(encode(text)) == text
+    Replace,      // every maximal ill-formed subpart is encoded as U+FFFD
+    Reject        // encode fails the same way it does for a disallowed special token
+};
+
+// The tokens of a batch of documents, back to back: document i is tokens[offsets[i]] up to tokens[offsets[i + 1]].
+struct TokenBatch {
+    tt_stl::vector<int> tokens;
+    tt_stl::vector<size_t> offsets;
+
+    [[nodiscard]] size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    [[nodiscard]] std::span<const int> operator[](size_t i) const
+    {
+        return { tokens.data() + offsets[i], offsets[i + 1] - offsets[i] };
+    }
+};
+
+// The decoded text of a batch of documents, laid out the same way as TokenBatch.
+struct TextBatch {
+    tt_stl::string text;
+    tt_stl::vector<size_t> offsets;
+
+    [[nodiscard]] size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    [[nodiscard]] std::string_view operator[](size_t i) const
+    {
+        return std::string_view(text).substr(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+};
+
+// What encode_into and decode_into wrote to a caller's span.
+struct BufferResult {
+    // Tokens or bytes in the whole output, which is more than was written when the span was too small.
+    size_t size = 0;
+    // Whether the output did not fit, so that only the first span.size() tokens or bytes were written.
+    bool overflow = false;
+};
+
+// The first tokens of a text, from encode_prefix.
+struct TokenPrefix {
+    tt_stl::vector<int> tokens;
+    // Bytes of the text that tokens stand for. Ill-formed UTF-8 under InvalidUtf8Policy::Replace is counted as the
+    // input bytes it replaces, so the text left out is always text.substr(offset).
+    size_t offset = 0;
+};
+
+// encode, decode and the other const members only read the encoding, so one instance can serve any number of threads
+// at once. set_invalid_utf8_policy must not race with them.
 class GptEncoding {
     int n_words;
     BytePairEncodingCore byte_pair_encoding_core_processor_;
+    InvalidUtf8Policy invalid_utf8_policy_ = InvalidUtf8Policy::ByteFallback;
 
-    GptEncoding(tt_stl::string&& pattern_string, bpe_encoding_t&& byte_pair_ranks,
+    GptEncoding(tt_stl::string&& pattern_string, RankTable&& rank_table,
         tt_stl::unordered_map<tt_stl::string, int>&& special_token_mappings, int explicit_n_vocab);
 
+    static GptEncoding get_encoding(LanguageModel model, BinaryVocabulary&& vocabulary);
+
+    // The text an encode works on once the special token and invalid UTF-8 policies have been applied to its input.
+    struct PreparedText {
+        // The input, or under InvalidUtf8Policy::Replace a copy of it with U+FFFD in place of invalid sequences.
+        std::string_view text;
+        // text split by break_into_specials, if prepare_text was asked to split it.
+        scratch_vector<std::string_view> segments;
+        // False only for invalid text under InvalidUtf8Policy::ByteFallback.
+        bool utf8_validated = true;
+        bool replaced = false;
+    };
+    // Checks line_to_encode against disallowed_special and then invalid_utf8_policy_, the order every encode entry
+    // point applies them in. Returns false if either rejects the text, which throws instead when exceptions are
+    // enabled. A replaced copy is made in replaced, which must outlive prepared.
+    bool prepare_text(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special, bool split, std::pmr::string &replaced,
+        PreparedText &prepared) const;
+    // encode, handing the tokens to emit a block at a time.
+    void encode_blocks(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special, BytePairEncodingCore::TokenBlockCallback emit,
+        void *context) const;
+    // Whether Token can hold every id of the encoding. Otherwise fails like any other invalid argument.
+    template <typename Token>
+    [[nodiscard]] bool check_token_type() const
+    {
+        static_assert(std::is_integral_v<Token>, "Tokens must be stored as integers");
+        if (static_cast<uintmax_t>(max_token_value()) <= static_cast<uintmax_t>(std::numeric_limits<Token>::max())) {
+            return true;
+        }
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+        throw std::invalid_argument("Token type is too narrow for this encoding");
+#else
+        return false;
+#endif
+    }
+    // token as the int the core takes, or -1, which decodes to nothing, if it does not fit one.
+    template <typename Token>
+    static int token_id(Token token)
+    {
+        if (std::cmp_greater(token, std::numeric_limits<int>::max())
+            || std::cmp_less(token, std::numeric_limits<int>::min())) {
+            return -1;
+        }
+        return static_cast<int>(token);
+    }
+
+    // encode, appending to tokens.
+    void encode_append(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special,
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special, tt_stl::vector<int> &tokens) const;
+
+    friend class StreamingDecoder;
+    friend class StreamingEncoder;
+
     GptEncoding(const GptEncoding&) = delete;
     GptEncoding &operator=(const GptEncoding&) = delete;
 
@@ -43,6 +158,10 @@ public:
     GptEncoding(GptEncoding &&) = default;
     GptEncoding &operator=(GptEncoding &&) = default;
 
+    // { "all" }: as disallowed_special, rejects a text that contains any special token, even one in allowed_special.
+    // To encode allowed special tokens as themselves, pass an empty disallowed_special.
+    static const tt_stl::unordered_set<tt_stl::string> &all_special_tokens();
+
     static GptEncoding get_encoding(ModelParams&& params);
     static GptEncoding get_encoding_llama3(ModelParams&& params);
     static GptEncoding get_encoding_llama3_1(ModelParams&& params);
@@ -50,11 +169,148 @@ public:
     static GptEncoding get_encoding(LanguageModel model, IResourceReader *resource_reader = nullptr, const char *resource_name = nullptr);
     static GptEncoding get_encoding_llama3(LanguageModel model, IResourceReader *resource_reader = nullptr, const char *resource_name = nullptr);
     static GptEncoding get_encoding_llama3_1(LanguageModel model, IResourceReader *resource_reader = nullptr, const char *resource_name = nullptr);
+    // Maps a vocabulary written by tools/tiktoken_to_binary.py instead of parsing a .tiktoken file. The split pattern
+    // comes from model, and so do the special tokens unless the file stores its own.
+    static GptEncoding get_encoding_from_binary(LanguageModel model, const tt_stl::string &path);
     tt_stl::vector<int> encode(const tt_stl::string &line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
-        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = { "all" });
-    tt_stl::string decode(const tt_stl::vector<int> &input_tokens_to_decode);
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = { "all" }) const;
+    // encode(...).size() without building the token vector. Rejected input counts as 0 tokens when exceptions are
+    // disabled, as encode returns no tokens for it. The default policy is the same as encode's, from a shared set so
+    // that a call allocates nothing.
+    [[nodiscard]] size_t count_tokens(std::string_view line_to_encode, const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens()) const;
+    // The first max_tokens tokens of encode, or all of them for a shorter text. Encoding stops soon after the budget
+    // is reached, so the time taken depends on max_tokens rather than on the length of the text; only for patterns
+    // without a hand-written pre-tokenizer, which have no known cut points, is the whole text encoded. Input encode
+    // rejects is only found in the part that was encoded, and then gives no tokens when exceptions are disabled.
+    [[nodiscard]] TokenPrefix encode_prefix(std::string_view line_to_encode, size_t max_tokens,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens()) const;
+    // count_tokens(...) <= max_tokens, stopping as soon as the answer is known as encode_prefix does.
+    [[nodiscard]] bool fits_within(std::string_view line_to_encode, size_t max_tokens,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens()) const;
+    // encode into tokens, with the bytes of line_to_encode that token i stands for in offsets[i], in the same pass.
+    // Both vectors are overwritten, so reusing them across calls saves their allocations. Under
+    // InvalidUtf8Policy::Replace a token that covers part of a U+FFFD is given the whole ill-formed subpart it
+    // replaced.
+    void encode_with_offsets(std::string_view line_to_encode, tt_stl::vector<int> &tokens, tt_stl::vector<ByteRange> &offsets,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens()) const;
+    tt_stl::string decode(const tt_stl::vector<int> &input_tokens_to_decode) const;
+    [[nodiscard]] size_t decoded_size(const tt_stl::vector<int> &input_tokens_to_decode) const;
+
+    // encode for every text, spread over executor, or ThreadPool::shared() if it is null. Documents are handed out in
+    // contiguous runs of about equal size. A document encode rejects comes out with no tokens when exceptions are
+    // disabled; otherwise the batch throws. A ThreadPool runs one batch at a time, so batches from several threads
+    // on the same pool take turns.
+    [[nodiscard]] TokenBatch encode_batch(std::span<const std::string_view> texts,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens(),
+        IExecutor *executor = nullptr) const;
+    // encode for one large text, cut into pieces that are encoded at the same time on executor, or
+    // ThreadPool::shared() if it is null. Cuts fall only where the pre-tokenizer would start a new piece anyway, so
+    // the tokens are exactly encode's. Short texts, patterns without a hand-written pre-tokenizer and ill-formed
+    // UTF-8 under InvalidUtf8Policy::ByteFallback are encoded on the calling thread.
+    [[nodiscard]] tt_stl::vector<int> encode_parallel(std::string_view line_to_encode,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens(),
+        IExecutor *executor = nullptr) const;
+    // decode for every document of tokens, laid out as in TokenBatch. offsets that do not fit tokens fail like
+    // any other invalid argument.
+    [[nodiscard]] TextBatch decode_batch(std::span<const int> tokens, std::span<const size_t> offsets,
+        IExecutor *executor = nullptr) const;
+    [[nodiscard]] TextBatch decode_batch(const TokenBatch &batch, IExecutor *executor = nullptr) const
+    {
+        return decode_batch(batch.tokens, batch.offsets, executor);
+    }
 
+    // encode, appending to tokens, any container of an integer type with end() and insert, such as a reused
+    // tt_stl::vector<uint32_t>. A type too narrow for max_token_value() fails like any other invalid argument, so
+    // uint16_t works for the 50k vocabularies and not for the larger ones.
+    template <typename Container>
+    void encode_into(std::string_view line_to_encode, Container &tokens,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens()) const
+    {
+        if (!check_token_type<typename Container::value_type>()) {
+            return;
+        }
+        encode_blocks(line_to_encode, allowed_special, disallowed_special, [](void *context, std::span<const int> block) {
+            auto &out = *static_cast<Container *>(context);
+            out.insert(out.end(), block.begin(), block.end());
+        }, &tokens);
+    }
+    // encode into tokens, writing as many as fit. Rejected input has size 0, as encode returns no tokens for it.
+    template <typename Token>
+    BufferResult encode_into(std::string_view line_to_encode, std::span<Token> tokens,
+        const tt_stl::unordered_set<tt_stl::string> &allowed_special = {},
+        const tt_stl::unordered_set<tt_stl::string> &disallowed_special = all_special_tokens()) const
+    {
+        struct target_t {
+            std::span<Token> tokens;
+            size_t size;
+        } target { tokens, 0 };
+        if (!check_token_type<Token>()) {
+            return {};
+        }
+        encode_blocks(line_to_encode, allowed_special, disallowed_special, [](void *context, std::span<const int> block) {
+            auto &target = *static_cast<target_t *>(context);
+            if (target.size < target.tokens.size()) {
+                const size_t count = std::min(block.size(), target.tokens.size() - target.size);
+                std::copy(block.begin(), block.begin() + count, target.tokens.begin() + target.size);
+            }
+            target.size += block.size();
+        }, &target);
+        return { target.size, target.size > tokens.size() };
+    }
+
+    // decode for tokens of any integer type, appending to text, a tt_stl::string, a std::pmr::string or any other
+    // string of char.
+    template <typename Token, typename String>
+    void decode_into(std::span<const Token> tokens, String &text) const
+    {
+        size_t size = 0;
+        for (const Token token: tokens) {
+            size += byte_pair_encoding_core_processor_.token_bytes(token_id(token)).size();
+        }
+        const size_t start = text.size();
+        text.resize(start + size);
+        decode_into(tokens, std::span<char>(text.data() + start, size));
+    }
+    // decode into text, writing as many bytes as fit.
+    template <typename Token>
+    BufferResult decode_into(std::span<const Token> tokens, std::span<char> text) const
+    {
+        size_t size = 0;
+        for (const Token token: tokens) {
+            const auto bytes = byte_pair_encoding_core_processor_.token_bytes(token_id(token));
+            if (size < text.size() && !bytes.empty()) {
+                std::memcpy(text.data() + size, bytes.data(), std::min(bytes.size(), text.size() - size));
+            }
+            size += bytes.size();
+        }
+        return { size, size > text.size() };
+    }
+
+    // The highest token id, which any type tokens are stored in has to hold.
+    [[nodiscard]] int max_token_value() const { return byte_pair_encoding_core_processor_.max_token_id(); }
+
+    // Built from the rank table on the first call.
     [[nodiscard]] const bpe_encoding_t& get_byte_pair_token_map() const;
+
+    // Caches the tokens of up to capacity frequent pieces that take more than one token, shared by every thread using
+    // this encoding. 0, the default, turns the cache off. Must not race with encoding.
+    void set_piece_cache_capacity(size_t capacity) { byte_pair_encoding_core_processor_.set_piece_cache_capacity(capacity); }
+    [[nodiscard]] PieceCacheStats piece_cache_stats() const { return byte_pair_encoding_core_processor_.piece_cache_stats(); }
+
+    // What encoding has done in this process, over every encoding and thread. Counted only when the library is built
+    // with TIKTOKEN_STATS_ENABLE (the CPP_TIKTOKEN_STATS CMake option); otherwise it is all zeros.
+    static EncodeStats stats() { return encode_stats(); }
+    static void reset_stats() { reset_encode_stats(); }
+
+    [[nodiscard]] InvalidUtf8Policy get_invalid_utf8_policy() const { return invalid_utf8_policy_; }
+    void set_invalid_utf8_policy(InvalidUtf8Policy policy) { invalid_utf8_policy_ = policy; }
 };
 
 }
@@ -0,0 +1,95 @@
+#include "encoding_registry.h"
+
+#include <mutex>
+#include <thread>
+
+namespace tiktoken
+{
+
+namespace
+{
+    struct entry_t
+    {
+        // Held while the entry loads, so that concurrent first calls wait for one load.
+        std::mutex mutex;
+        // Null until a load succeeds.
+        std::shared_ptr<const GptEncoding> encoding;
+    };
+
+    struct registry_t
+    {
+        std::mutex mutex;
+        tt_stl::unordered_map<tt_stl::string, std::shared_ptr<entry_t>> entries;
+    };
+
+    // Built on first use, so that a get from another translation unit's static initializer finds it constructed.
+    registry_t &registry()
+    {
+        static registry_t instance;
+        return instance;
+    }
+
+    tt_stl::string entry_key(LanguageModel model, const char *resource_name, EncodingVariant variant)
+    {
+        tt_stl::string key = tt_stl::to_string(static_cast<int>(variant)) + ':' + tt_stl::to_string(static_cast<int>(model)) + ':';
+        if (resource_name) {
+            key += resource_name;
+        }
+        return key;
+    }
+
+    // Null if the vocabulary could not be read.
+    std::shared_ptr<const GptEncoding> load(LanguageModel model, IResourceReader *resource_reader,
+        const char *resource_name, EncodingVariant variant)
+    {
+        ModelParams params = ModelParamsGenerator::get_model_params(model, resource_name, resource_reader);
+        if (params.mergeable_ranks.token_count() == 0) {
+            return nullptr;
+        }
+        switch (variant) {
+            case EncodingVariant::Llama3:
+                return std::make_shared<const GptEncoding>(GptEncoding::get_encoding_llama3(std::move(params)));
+            case EncodingVariant::Llama3_1:
+                return std::make_shared<const GptEncoding>(GptEncoding::get_encoding_llama3_1(std::move(params)));
+            case EncodingVariant::Default:
+                break;
+        }
+        return std::make_shared<const GptEncoding>(GptEncoding::get_encoding(std::move(params)));
+    }
+}
+
+std::shared_ptr<const GptEncoding> EncodingRegistry::get(LanguageModel model, IResourceReader *resource_reader,
+    const char *resource_name, EncodingVariant variant)
+{
+    std::shared_ptr<entry_t> entry;
+    {
+        // Only the lookup is serialised; loading one model does not block loading another.
+        registry_t &instance = registry();
+        std::lock_guard<std::mutex> lock(instance.mutex);
+        auto &slot = instance.entries[entry_key(model, resource_name, variant)];
+        if (!slot) {
+            slot = std::make_shared<entry_t>();
+        }
+        entry = slot;
+    }
+    // A load that fails, or throws, leaves encoding null, and the next call for the key tries again.
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (!entry->encoding) {
+        entry->encoding = load(model, resource_reader, resource_name, variant);
+    }
+    return entry->encoding;
+}
+
+void EncodingRegistry::warm_up(const tt_stl::vector<LanguageModel> &models, EncodingVariant variant)
+{
+    tt_stl::vector<std::thread> threads;
+    threads.reserve(models.size());
+    for (const LanguageModel model: models) {
+        threads.emplace_back([model, variant] { get(model, nullptr, nullptr, variant); });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+#include "encoding.h"
+#include "modelparams.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tiktoken
+{
+
+class IResourceReader;
+
+// Which GptEncoding factory builds a registry entry.
+enum class EncodingVariant {
+    Default, // GptEncoding::get_encoding
+    Llama3,  // GptEncoding::get_encoding_llama3
+    Llama3_1 // GptEncoding::get_encoding_llama3_1
+};
+
+// Process-wide cache of loaded encodings, so the vocabulary is parsed once rather than on every get_encoding call.
+// Entries are keyed by variant, model and resource name and live until the process exits.
+class EncodingRegistry {
+public:
+    // Loads the encoding on first use; concurrent first calls for the same key wait for a single load. The resource
+    // reader is only consulted when the entry is loaded, so it has to return the same data for the same name. Returns
+    // null if the vocabulary could not be read; a failed load is not cached, so a later call tries again.
+    static std::shared_ptr<const GptEncoding> get(LanguageModel model, IResourceReader *resource_reader = nullptr,
+        const char *resource_name = nullptr, EncodingVariant variant = EncodingVariant::Default);
+
+    // Loads the default resource of every listed model up front, one thread per model, e.g. during server startup.
+    static void warm_up(const tt_stl::vector<LanguageModel> &models, EncodingVariant variant = EncodingVariant::Default);
+};
+
+}
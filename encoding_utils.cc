@@ -17,58 +17,238 @@
  */
 #include "encoding_utils.h"
 
+#include <algorithm>
+#include <array>
+
+// Only the ASCII fast path in find_invalid is vectorized. Validating multi-byte sequences with SIMD takes byte
+// shuffles (SSSE3 or newer), which the baseline x86-64 target does not have, so those are checked one at a time.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TIKTOKEN_UTF8_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TIKTOKEN_UTF8_NEON 1
+#endif
+
 namespace tiktoken
 {
 
-static tt_stl::string base64_chars = 
-"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-"abcdefghijklmnopqrstuvwxyz"
-"0123456789+/";
-
 namespace base64 {
-static auto constexpr fillchar = '=';
 
-static constexpr std::string_view cvt = 
-"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-"abcdefghijklmnopqrstuvwxyz"
-"0123456789+/";
+namespace
+{
+    constexpr uint8_t invalid = 0xFF;
+
+    // The 6-bit value of each alphabet character, and invalid for every other byte, padding included.
+    constexpr std::array<uint8_t, 256> values = [] {
+        constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                              "abcdefghijklmnopqrstuvwxyz"
+                                              "0123456789+/";
+        std::array<uint8_t, 256> table {};
+        table.fill(invalid);
+        for (size_t i = 0; i < alphabet.size(); ++i) {
+            table[static_cast<uint8_t>(alphabet[i])] = static_cast<uint8_t>(i);
+        }
+        return table;
+    }();
+}
+
+size_t decode_into(std::string_view data, uint8_t *output)
+{
+    const auto *input = reinterpret_cast<const uint8_t *>(data.data());
+    const size_t size = data.size();
+    uint8_t *out = output;
+    size_t i = 0;
+    // Whole groups of four characters, which all but the last group of a padded string are.
+    for (; i + 4 <= size; i += 4) {
+        const uint32_t a = values[input[i]];
+        const uint32_t b = values[input[i + 1]];
+        const uint32_t c = values[input[i + 2]];
+        const uint32_t d = values[input[i + 3]];
+        if (((a | b | c | d) & 0x80) != 0) {
+            break;
+        }
+        const uint32_t group = a << 18 | b << 12 | c << 6 | d;
+        out[0] = static_cast<uint8_t>(group >> 16);
+        out[1] = static_cast<uint8_t>(group >> 8);
+        out[2] = static_cast<uint8_t>(group);
+        out += 3;
+    }
+    // A short or padded last group, which ends at the first character outside the alphabet.
+    uint32_t group = 0;
+    size_t count = 0;
+    for (; i < size && count < 4 && values[input[i]] != invalid; ++i, ++count) {
+        group = group << 6 | values[input[i]];
+    }
+    if (count >= 2) {
+        group <<= 6 * (4 - count);
+        *out++ = static_cast<uint8_t>(group >> 16);
+        if (count >= 3) {
+            *out++ = static_cast<uint8_t>(group >> 8);
+        }
+    }
+    return static_cast<size_t>(out - output);
+}
 
 tt_stl::vector<uint8_t> decode(std::string_view data)
 {
-    tt_stl::string::size_type i;
-    char c;
-    char c1;
-    tt_stl::string::size_type len = data.length();
-    tt_stl::vector<uint8_t> ret;
-
-    for (i = 0; i < len; ++i) {
-        c = (char)cvt.find(data[i]);
-        ++i;
-        c1 = (char)cvt.find(data[i]);
-        c = (c << 2) | ((c1 >> 4) & 0x3);
-        ret.push_back(c);
-        if (++i < len) {
-            c = data[i];
-            if (fillchar == c) {
+    tt_stl::vector<uint8_t> ret(decoded_size_bound(data.size()));
+    ret.resize(decode_into(data, ret.data()));
+    return ret;
+}
+
+} // namespace base64
+
+namespace utf8 {
+
+namespace
+{
+    // Length of the well-formed sequence starting at text[0], or 0 if there is none, in which case
+    // *ill_formed_length receives the length of the maximal ill-formed subpart (see Unicode table 3-7).
+    size_t sequence_length(const uint8_t *text, size_t size, size_t *ill_formed_length)
+    {
+        const uint8_t lead = text[0];
+        size_t length = 0;
+        uint8_t lower = 0x80;
+        uint8_t upper = 0xBF;
+        if (lead < 0x80) {
+            return 1;
+        } else if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead == 0xE0) {
+            length = 3;
+            lower = 0xA0;
+        } else if (lead == 0xED) {
+            length = 3;
+            upper = 0x9F;
+        } else if (lead >= 0xE1 && lead <= 0xEF) {
+            length = 3;
+        } else if (lead == 0xF0) {
+            length = 4;
+            lower = 0x90;
+        } else if (lead == 0xF4) {
+            length = 4;
+            upper = 0x8F;
+        } else if (lead >= 0xF1 && lead <= 0xF3) {
+            length = 4;
+        } else {
+            *ill_formed_length = 1;
+            return 0;
+        }
+
+        size_t i = 1;
+        for (; i < length && i < size; ++i) {
+            if (text[i] < lower || text[i] > upper) {
+                break;
+            }
+            lower = 0x80;
+            upper = 0xBF;
+        }
+        if (i == length) {
+            return length;
+        }
+        *ill_formed_length = i;
+        return 0;
+    }
+
+    // Skips the run of ASCII bytes starting at offset, sixteen bytes at a time where SIMD is available.
+    size_t skip_ascii(const uint8_t *text, size_t size, size_t offset)
+    {
+#if defined(TIKTOKEN_UTF8_SSE2)
+        for (; offset + 16 <= size; offset += 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + offset));
+            if (_mm_movemask_epi8(block) != 0) {
                 break;
             }
-            c = (char)cvt.find(c);
-            c1 = ((c1 << 4) & 0xf0) | ((c >> 2) & 0xf);
-            ret.push_back(c1);
         }
-        if (++i < len) {
-            c1 = data[i];
-            if (fillchar == c1) {
+#elif defined(TIKTOKEN_UTF8_NEON)
+        for (; offset + 16 <= size; offset += 16) {
+            if (vmaxvq_u8(vld1q_u8(text + offset)) >= 0x80) {
                 break;
             }
-            c1 = (char)cvt.find(c1);
-            c = ((c << 6) & 0xc0) | c1;
-            ret.push_back(c);
         }
+#endif
+        while (offset < size && text[offset] < 0x80) {
+            ++offset;
+        }
+        return offset;
     }
-    return (ret);
 }
 
-} // namespace base64
+size_t find_invalid(std::string_view text)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t *>(text.data());
+    const size_t size = text.size();
+    size_t offset = skip_ascii(bytes, size, 0);
+    while (offset < size) {
+        size_t ill_formed_length = 0;
+        const size_t length = sequence_length(bytes + offset, size - offset, &ill_formed_length);
+        if (length == 0) {
+            return offset;
+        }
+        offset = skip_ascii(bytes, size, offset + length);
+    }
+    return std::string_view::npos;
+}
 
-}
\ No newline at end of file
+size_t invalid_sequence_length(std::string_view text)
+{
+    size_t ill_formed_length = 1;
+    if (!text.empty()) {
+        sequence_length(reinterpret_cast<const uint8_t *>(text.data()), text.size(), &ill_formed_length);
+    }
+    return ill_formed_length;
+}
+
+namespace
+{
+    template <typename String>
+    void append_replaced(std::string_view text, String &result)
+    {
+        static constexpr std::string_view replacement_character = "\xEF\xBF\xBD";
+
+        result.reserve(text.size());
+        size_t invalid_offset;
+        while ((invalid_offset = find_invalid(text)) != std::string_view::npos) {
+            result.append(text.data(), invalid_offset);
+            result.append(replacement_character);
+            text.remove_prefix(invalid_offset + invalid_sequence_length(text.substr(invalid_offset)));
+        }
+        result.append(text);
+    }
+}
+
+tt_stl::string replace_invalid(std::string_view text)
+{
+    tt_stl::string result;
+    append_replaced(text, result);
+    return result;
+}
+
+std::pmr::string replace_invalid(std::string_view text, std::pmr::memory_resource *resource)
+{
+    std::pmr::string result(resource);
+    append_replaced(text, result);
+    return result;
+}
+
+size_t incomplete_suffix_length(std::string_view text)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t *>(text.data());
+    for (size_t back = 1; back <= std::min<size_t>(3, text.size()); ++back) {
+        const uint8_t lead = bytes[text.size() - back];
+        if ((lead & 0xC0) == 0x80) {
+            continue;
+        }
+        // A truncated sequence reports all of its bytes as the ill-formed subpart
+        size_t ill_formed_length = 0;
+        const bool incomplete = lead >= 0xC2 && lead <= 0xF4
+            && sequence_length(bytes + text.size() - back, back, &ill_formed_length) == 0 && ill_formed_length == back;
+        return incomplete ? back : 0;
+    }
+    return 0;
+}
+
+} // namespace utf8
+
+}
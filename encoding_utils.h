@@ -18,6 +18,7 @@
 #pragma once
 
 #include <cstdint>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -29,7 +30,33 @@ namespace tiktoken
 
 namespace base64 
 {
+// The most bytes input_size characters decode to.
+constexpr size_t decoded_size_bound(size_t input_size)
+{
+    return input_size / 4 * 3 + 2;
+}
+// Decodes input into output, which must hold decoded_size_bound(input.size()) bytes, and returns the number of bytes
+// written. Decoding stops at padding or at any other character outside the alphabet.
+size_t decode_into(std::string_view input, uint8_t *output);
 tt_stl::vector<uint8_t> decode(std::string_view input);
 }
 
+namespace utf8
+{
+// Offset of the first byte that does not begin a well-formed UTF-8 sequence, or npos if text is valid UTF-8. Runs of
+// ASCII are skipped sixteen bytes at a time with SSE2 or NEON; every non-ASCII sequence is checked with scalar code,
+// so CJK, emoji and other mostly non-ASCII text validates at scalar speed.
+size_t find_invalid(std::string_view text);
+// Length of the maximal ill-formed subpart at the start of text, which is never less than one byte.
+// This is the unit that gets a single U+FFFD under the Unicode "substitution of maximal subparts" practice.
+size_t invalid_sequence_length(std::string_view text);
+// Copy of text with every maximal ill-formed subpart replaced by U+FFFD.
+tt_stl::string replace_invalid(std::string_view text);
+// replace_invalid, allocating the copy from resource.
+std::pmr::string replace_invalid(std::string_view text, std::pmr::memory_resource *resource);
+// Length of the bytes at the end of text that start a well-formed sequence without finishing it, so that more bytes
+// may still complete it. At most 3.
+size_t incomplete_suffix_length(std::string_view text);
+}
+
 }
@@ -29,13 +29,25 @@ ModelParams::ModelParams() :
 }
 
 ModelParams::ModelParams(int explicit_n_vocab, tt_stl::string &&pat_str,
-    bpe_encoding_t&& mergeable_ranks,
+    RankTable&& mergeable_ranks,
     tt_stl::unordered_map<tt_stl::string, int>&& special_tokens) :
     explicit_n_vocab(explicit_n_vocab),
     pat_str(std::move(pat_str)), mergeable_ranks(std::move(mergeable_ranks)), special_tokens(std::move(special_tokens))
 {
 }
 
+ModelParams::ModelParams(int explicit_n_vocab, tt_stl::string &&pat_str,
+    bpe_encoding_t&& mergeable_ranks,
+    tt_stl::unordered_map<tt_stl::string, int>&& special_tokens) :
+    ModelParams(explicit_n_vocab, std::move(pat_str), RankTable(mergeable_ranks), std::move(special_tokens))
+{
+}
+
+bpe_encoding_t ModelParams::mergeable_ranks_map() const
+{
+    return mergeable_ranks.to_map();
+}
+
 // ModelParamsGenerator member functions
 
 ModelParams ModelParamsGenerator::get_model_params(LanguageModel model, const char *resource_name, IResourceReader *resource_reader)
@@ -51,6 +63,8 @@ ModelParams ModelParamsGenerator::get_model_params(LanguageModel model, const ch
             return p50k_edit(resource_name, resource_reader);
         case LanguageModel::R50K_BASE:
             return r50k_base(resource_name, resource_reader);
+        case LanguageModel::COUNT:
+            break;
     }
 #if TIKTOKEN_EXCEPTIONS_ENABLE
     throw std::runtime_error("Invalid argument to get_model_params");
@@ -71,6 +85,58 @@ static auto constexpr cl100k_pattern = "(?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\\r\\n\\p
 static auto constexpr p50k_pattern = "'s|'t|'re|'ve|'m|'ll|'d| ?\\p{L}+| ?\\p{N}+| ?[^\\s\\p{L}\\p{N}]+|\\s+(?!\\S)|\\s+";
 #endif
 
+const char *ModelParamsGenerator::get_pattern(LanguageModel model)
+{
+    switch (model) {
+        case LanguageModel::O200K_BASE:
+            return o200k_pattern;
+        case LanguageModel::CL100K_BASE:
+            return cl100k_pattern;
+        case LanguageModel::R50K_BASE:
+        case LanguageModel::P50K_BASE:
+        case LanguageModel::P50K_EDIT:
+            return p50k_pattern;
+        case LanguageModel::COUNT:
+            break;
+    }
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+    throw std::runtime_error("Invalid argument to get_pattern");
+#else
+    return nullptr;
+#endif
+}
+
+tt_stl::unordered_map<tt_stl::string, int> ModelParamsGenerator::get_special_tokens(LanguageModel model)
+{
+    switch (model) {
+        case LanguageModel::O200K_BASE:
+            return { { EndOfText, 199999 }, { EndOfPrompt, 200018 } };
+        case LanguageModel::CL100K_BASE:
+            return { { EndOfText, 100257 }, { FimPrefix, 100258 }, { FimMiddle, 100259 }, { FimSuffix, 100260 },
+                { EndOfPrompt, 100276 } };
+        case LanguageModel::R50K_BASE:
+        case LanguageModel::P50K_BASE:
+            return { { EndOfText, 50256 } };
+        case LanguageModel::P50K_EDIT:
+            return { { EndOfText, 50256 }, { FimPrefix, 50281 }, { FimMiddle, 50282 }, { FimSuffix, 50283 } };
+        case LanguageModel::COUNT:
+            break;
+    }
+    return {};
+}
+
+int ModelParamsGenerator::get_explicit_n_vocab(LanguageModel model)
+{
+    switch (model) {
+        case LanguageModel::R50K_BASE:
+            return 50257;
+        case LanguageModel::P50K_BASE:
+            return 50281;
+        default:
+            return 0;
+    }
+}
+
 constexpr const char* embedded_resource_from_model(LanguageModel model)
 {
     constexpr const char* resource_name[(int)LanguageModel::COUNT] = {
@@ -89,10 +155,10 @@ ModelParams ModelParamsGenerator::r50k_base(const char *resource_name, IResource
     resource_name = resource_name ? resource_name : embedded_resource_from_model(LanguageModel::R50K_BASE);
 
     EmbeddedResourceLoader loader(resource_name, resource_reader);
-    return ModelParams(50257, 
+    return ModelParams(get_explicit_n_vocab(LanguageModel::R50K_BASE), 
         p50k_pattern, 
-        loader.loadTokenBytePairEncoding(), 
-        { { EndOfText, 50256 } });
+        loader.loadRankTable(), 
+        get_special_tokens(LanguageModel::R50K_BASE));
 }
 
 ModelParams ModelParamsGenerator::p50k_base(const char *resource_name, IResourceReader *resource_reader)
@@ -100,10 +166,10 @@ ModelParams ModelParamsGenerator::p50k_base(const char *resource_name, IResource
     resource_name = resource_name ? resource_name : embedded_resource_from_model(LanguageModel::P50K_BASE);
 
     EmbeddedResourceLoader loader(resource_name, resource_reader);
-    return ModelParams(50281, 
+    return ModelParams(get_explicit_n_vocab(LanguageModel::P50K_BASE), 
         p50k_pattern, 
-        loader.loadTokenBytePairEncoding(), 
-        { { EndOfText, 50256 } });
+        loader.loadRankTable(), 
+        get_special_tokens(LanguageModel::P50K_BASE));
 }
 
 ModelParams ModelParamsGenerator::p50k_edit(const char *resource_name, IResourceReader *resource_reader)
@@ -112,13 +178,10 @@ ModelParams ModelParamsGenerator::p50k_edit(const char *resource_name, IResource
 
     EmbeddedResourceLoader loader(resource_name, resource_reader);
 
-    tt_stl::unordered_map<tt_stl::string, int> specialTokens = { { EndOfText, 50256 }, { FimPrefix, 50281 }, { FimMiddle, 50282 },
-        { FimSuffix, 50283 } };
-
-    return ModelParams(0, 
+    return ModelParams(get_explicit_n_vocab(LanguageModel::P50K_EDIT), 
         p50k_pattern, 
-        loader.loadTokenBytePairEncoding(), 
-        std::move(specialTokens));
+        loader.loadRankTable(), 
+        get_special_tokens(LanguageModel::P50K_EDIT));
 }
 
 ModelParams ModelParamsGenerator::cl100k_base(const char *resource_name, IResourceReader *resource_reader)
@@ -127,13 +190,10 @@ ModelParams ModelParamsGenerator::cl100k_base(const char *resource_name, IResour
 
     EmbeddedResourceLoader loader(resource_name, resource_reader);
 
-    tt_stl::unordered_map<tt_stl::string, int> specialTokens = { { EndOfText, 100257 }, { FimPrefix, 100258 }, { FimMiddle, 100259 },
-        { FimSuffix, 100260 }, { EndOfPrompt, 100276 } };
-
-    return ModelParams(0, 
+    return ModelParams(get_explicit_n_vocab(LanguageModel::CL100K_BASE), 
         cl100k_pattern, 
-        loader.loadTokenBytePairEncoding(), 
-        std::move(specialTokens));
+        loader.loadRankTable(), 
+        get_special_tokens(LanguageModel::CL100K_BASE));
 }
 
 ModelParams ModelParamsGenerator::o200k_base(const char *resource_name, IResourceReader *resource_reader)
@@ -142,12 +202,10 @@ ModelParams ModelParamsGenerator::o200k_base(const char *resource_name, IResourc
 
     EmbeddedResourceLoader loader(resource_name, resource_reader);
 
-    tt_stl::unordered_map<tt_stl::string, int> specialTokens = { { EndOfText, 199999 }, { EndOfPrompt, 200018 } };
-
-    return ModelParams(0, 
+    return ModelParams(get_explicit_n_vocab(LanguageModel::O200K_BASE), 
         o200k_pattern, 
-        loader.loadTokenBytePairEncoding(), 
-        std::move(specialTokens));
+        loader.loadRankTable(), 
+        get_special_tokens(LanguageModel::O200K_BASE));
 }
 
-}
\ No newline at end of file
+}
@@ -19,6 +19,7 @@
 
 #include "common.h"
 #include "encoding_utils.h"
+#include "rank_table.h"
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -29,13 +30,20 @@ namespace tiktoken
 class ModelParams {
 public:
     ModelParams();
+    ModelParams(int explicit_n_vocab, tt_stl::string&& pat_str,
+        RankTable&& mergeable_ranks,
+        tt_stl::unordered_map<tt_stl::string, int>&& special_tokens);
+    // The map form the ranks used to be given in, kept for existing callers.
     ModelParams(int explicit_n_vocab, tt_stl::string&& pat_str,
         bpe_encoding_t&& mergeable_ranks,
         tt_stl::unordered_map<tt_stl::string, int>&& special_tokens);
 
+    // mergeable_ranks as the map it used to be, built on each call.
+    [[nodiscard]] bpe_encoding_t mergeable_ranks_map() const;
+
     int explicit_n_vocab;
     tt_stl::string pat_str;
-    bpe_encoding_t mergeable_ranks;
+    RankTable mergeable_ranks;
     tt_stl::unordered_map<tt_stl::string, int> special_tokens;
 };
 
@@ -54,6 +62,9 @@ class IResourceReader;
 class ModelParamsGenerator {
 public:
     static ModelParams get_model_params(LanguageModel model, const char* resource_name = nullptr, IResourceReader* resource_reader = nullptr);
+    static const char *get_pattern(LanguageModel model);
+    static tt_stl::unordered_map<tt_stl::string, int> get_special_tokens(LanguageModel model);
+    static int get_explicit_n_vocab(LanguageModel model);
     static auto constexpr EndOfText = "<|endoftext|>";
     static auto constexpr FimPrefix = "<|fim_prefix|>";
     static auto constexpr FimMiddle = "<|fim_middle|>";
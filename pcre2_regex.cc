@@ -30,12 +30,42 @@ namespace impl
 {
     using state_t = void*;
 
+    struct state_data_t
+    {
+        pcre2_code_8 *regex;
+        bool jit_compiled;
+        PCRERegex::MatchLimits limits;
+    };
+
+    state_data_t* state_get(state_t state)
+    {
+        return reinterpret_cast<state_data_t *>(state);
+    }
+
     pcre2_code_8* state_get_regex(state_t state)
     {
-        return reinterpret_cast<pcre2_code_8 *>(state);
+        return state_get(state)->regex;
     }
 
-    state_t state_create(const tt_stl::string &pattern, int flags)
+    bool jit_available()
+    {
+        static const bool available = [] {
+            uint32_t jit = 0;
+            return pcre2_config_8(PCRE2_CONFIG_JIT, &jit) >= 0 && jit != 0;
+        }();
+        return available;
+    }
+
+    PCRERegex::MatchLimits default_match_limits()
+    {
+        PCRERegex::MatchLimits limits {};
+        pcre2_config_8(PCRE2_CONFIG_MATCHLIMIT, &limits.match_limit);
+        pcre2_config_8(PCRE2_CONFIG_DEPTHLIMIT, &limits.depth_limit);
+        pcre2_config_8(PCRE2_CONFIG_HEAPLIMIT, &limits.heap_limit);
+        return limits;
+    }
+
+    state_t state_create(const tt_stl::string &pattern, int flags, bool use_jit)
     {
         int error = 0;
         PCRE2_SIZE error_offset = 0;
@@ -52,50 +82,114 @@ namespace impl
 #endif
         }
 
-        return (state_t) regex;
+        // A pattern the JIT cannot handle still matches correctly through the interpreter.
+        const bool jit_compiled = use_jit && jit_available() && pcre2_jit_compile_8(regex, PCRE2_JIT_COMPLETE) == 0;
+        return (state_t) new state_data_t { regex, jit_compiled, default_match_limits() };
     }
 
     void state_free(state_t state)
     {
         if (state) {
             pcre2_code_free_8(state_get_regex(state));
+            delete state_get(state);
         }
     }
 
-    tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>>
-    all_matches(state_t state, const tt_stl::string &text) 
+    // Match data, match context and JIT stack are created once per thread and reused by every match on it.
+    // Only the overall match offsets are read, so a single ovector pair is enough for any pattern.
+    class match_scratch_t
     {
-        tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>> result;
-        auto text_ptr = reinterpret_cast<PCRE2_SPTR8>(text.c_str());
+    public:
+        match_scratch_t() :
+            match_data(pcre2_match_data_create_8(1, nullptr)),
+            match_context(pcre2_match_context_create_8(nullptr)),
+            jit_stack(jit_available() ? pcre2_jit_stack_create_8(32 * 1024, 1024 * 1024, nullptr) : nullptr)
+        {
+            if (jit_stack) {
+                pcre2_jit_stack_assign_8(match_context, nullptr, jit_stack);
+            }
+        }
+
+        ~match_scratch_t()
+        {
+            pcre2_jit_stack_free_8(jit_stack);
+            pcre2_match_context_free_8(match_context);
+            pcre2_match_data_free_8(match_data);
+        }
+
+        match_scratch_t(const match_scratch_t &) = delete;
+        match_scratch_t &operator=(const match_scratch_t &) = delete;
+
+        pcre2_match_data_8 *const match_data;
+        pcre2_match_context_8 *const match_context;
+        pcre2_jit_stack_8 *const jit_stack;
+    };
+
+    match_scratch_t &thread_match_scratch()
+    {
+        thread_local match_scratch_t scratch;
+        return scratch;
+    }
+
+    template <typename Callback>
+    void for_each_match(state_t state, std::string_view text, Callback &&callback, bool utf8_validated = false)
+    {
+        if (!state) {
+            return;
+        }
+        const state_data_t &data = *state_get(state);
+        match_scratch_t &scratch = thread_match_scratch();
+        pcre2_set_match_limit_8(scratch.match_context, data.limits.match_limit);
+        pcre2_set_depth_limit_8(scratch.match_context, data.limits.depth_limit);
+        pcre2_set_heap_limit_8(scratch.match_context, data.limits.heap_limit);
+
+        auto text_ptr = reinterpret_cast<PCRE2_SPTR8>(text.data());
         PCRE2_SIZE text_length = text.size();
-        pcre2_match_data_8 *match_data = pcre2_match_data_create_from_pattern_8(state_get_regex(state), nullptr);
-        int start_offset = 0;
-        int match_length;
+        PCRE2_SIZE start_offset = 0;
+        PCRE2_SIZE match_length = 0;
+        // Without PCRE2_NO_UTF_CHECK every call re-validates the subject from start_offset to its end, which
+        // makes matching a long text quadratic. The first successful call has validated all of it already.
+        uint32_t options = utf8_validated ? PCRE2_NO_UTF_CHECK : 0;
         int rc;
         do {
-            rc = pcre2_match_8(state_get_regex(state), text_ptr, text_length, start_offset, 0, match_data, nullptr);
+            rc = pcre2_match_8(data.regex, text_ptr, text_length, start_offset, options, scratch.match_data, scratch.match_context);
+            options = PCRE2_NO_UTF_CHECK;
             if (rc >= 0) {
-                PCRE2_SIZE *o_vec = pcre2_get_ovector_pointer_8(match_data);
-                match_length = static_cast<int>(o_vec[1] - o_vec[0]);
-                result.emplace_back(o_vec[0], match_length);
-                start_offset = static_cast<int>(o_vec[1]);
+                PCRE2_SIZE *o_vec = pcre2_get_ovector_pointer_8(scratch.match_data);
+                match_length = o_vec[1] - o_vec[0];
+                callback(o_vec[0], match_length);
+                start_offset = o_vec[1];
             }
         } while (rc >= 0 && start_offset < text_length && match_length > 0);
-        pcre2_match_data_free_8(match_data);
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+        if (rc < 0 && rc != PCRE2_ERROR_NOMATCH) {
+            char buffer[512];
+            pcre2_get_error_message_8(rc, reinterpret_cast<PCRE2_UCHAR8 *>(buffer), sizeof(buffer));
+            throw std::runtime_error(buffer);
+        }
+#endif
+    }
+
+    tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>>
+    all_matches(state_t state, std::string_view text)
+    {
+        tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>> result;
+        for_each_match(state, text, [&result](size_t offset, size_t length) {
+            result.emplace_back(offset, length);
+        });
         return result;
     }
 
-    tt_stl::vector<tt_stl::string> get_all_matches(state_t state, const tt_stl::string &text) 
+    tt_stl::vector<tt_stl::string> get_all_matches(state_t state, std::string_view text)
     {
         tt_stl::vector<tt_stl::string> matches;
-        auto pairs = all_matches(state, text);
-        for(auto &x:pairs) {
-            matches.emplace_back(text.substr(x.first, x.second));
-        }
+        for_each_match(state, text, [&matches, text](size_t offset, size_t length) {
+            matches.emplace_back(text.substr(offset, length));
+        });
         return matches;
     }
 
-    bool contains(state_t state, const tt_stl::string &text) 
+    bool contains(state_t state, std::string_view text)
     {
         return !all_matches(state, text).empty();
     }
@@ -115,8 +209,8 @@ namespace impl
     }
 }
 
-PCRERegex::PCRERegex(const tt_stl::string &pattern, int flags)
-    : impl_state_(impl::state_create(pattern, flags))
+PCRERegex::PCRERegex(const tt_stl::string &pattern, int flags, bool use_jit)
+    : impl_state_(impl::state_create(pattern, flags, use_jit))
 {
 }
 
@@ -137,8 +231,24 @@ PCRERegex::~PCRERegex()
     impl::state_free(impl_state_);
 }
 
+bool PCRERegex::is_jit_compiled() const
+{
+    return impl_state_ && impl::state_get(impl_state_)->jit_compiled;
+}
+
+PCRERegex::MatchLimits PCRERegex::get_match_limits() const
+{
+    return impl_state_ ? impl::state_get(impl_state_)->limits : impl::default_match_limits();
+}
+
+void PCRERegex::set_match_limits(const MatchLimits &limits)
+{
+    if (impl_state_) {
+        impl::state_get(impl_state_)->limits = limits;
+    }
+}
 
-tt_stl::vector<tt_stl::string> PCRERegex::get_all_matches(const tt_stl::string &text) const 
+tt_stl::vector<tt_stl::string> PCRERegex::get_all_matches(std::string_view text) const
 {
     return impl::get_all_matches(impl_state_, text);
 }
@@ -148,14 +258,22 @@ void PCRERegex::replace_all(tt_stl::string &text, const tt_stl::string &replacem
     impl::replace_all(impl_state_, text, replacement);
 }
 
-bool PCRERegex::contains(const tt_stl::string& text) const 
+bool PCRERegex::contains(std::string_view text) const
 {
     return impl::contains(impl_state_, text);
 }
 
-tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>> PCRERegex::all_matches(const tt_stl::string &text) const
+tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>> PCRERegex::all_matches(std::string_view text) const
 {
     return impl::all_matches(impl_state_, text);
 }
 
+void PCRERegex::for_each_match_impl(std::string_view text, void (*callback)(void *, size_t, size_t), void *context,
+    bool utf8_validated) const
+{
+    impl::for_each_match(impl_state_, text, [callback, context](size_t offset, size_t length) {
+        callback(context, offset, length);
+    }, utf8_validated);
+}
+
 }
@@ -18,8 +18,11 @@
 #pragma once
 
 #include "common.h"
+#include <cstdint>
 #include <cstring>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace tiktoken
@@ -28,19 +31,48 @@ namespace tiktoken
 class PCRERegex {
     class Impl;
 public:
-    explicit PCRERegex(const tt_stl::string &pattern, int flags = 0);
+    // Resource limits applied to every match, see pcre2_set_match_limit, pcre2_set_depth_limit and
+    // pcre2_set_heap_limit. A newly compiled regex starts with the library's built-in defaults.
+    struct MatchLimits {
+        uint32_t match_limit;
+        uint32_t depth_limit;
+        uint32_t heap_limit;
+    };
+
+    // The pattern is JIT compiled when use_jit is set and the PCRE2 build supports it; otherwise, or if JIT
+    // compilation fails, matching falls back to the interpreter.
+    explicit PCRERegex(const tt_stl::string &pattern, int flags = 0, bool use_jit = true);
     PCRERegex(PCRERegex&&);
     PCRERegex& operator=(PCRERegex&&);
     PCRERegex& operator=(const PCRERegex&) = delete;
     PCRERegex(const PCRERegex &) = delete;
     ~PCRERegex();
 
-    [[nodiscard]] tt_stl::vector<tt_stl::string> get_all_matches(const tt_stl::string &text) const;
+    [[nodiscard]] bool is_jit_compiled() const;
+    [[nodiscard]] MatchLimits get_match_limits() const;
+    // Not synchronised with concurrent matches; configure the regex before sharing it between threads.
+    void set_match_limits(const MatchLimits &limits);
+
+    [[nodiscard]] tt_stl::vector<tt_stl::string> get_all_matches(std::string_view text) const;
     void replace_all(tt_stl::string &text, const tt_stl::string &replacement) const;
-    [[nodiscard]] bool contains(const tt_stl::string& text) const;
-    [[nodiscard]] tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>> all_matches(const tt_stl::string &text) const;
+    [[nodiscard]] bool contains(std::string_view text) const;
+    [[nodiscard]] tt_stl::vector<std::pair<tt_stl::string::size_type, tt_stl::string::size_type>> all_matches(std::string_view text) const;
+
+    // Calls callback(offset, length) for every match in text, in order, without collecting the matches first.
+    // PCRE2 validates the subject as UTF-8 once per call; pass utf8_validated when the caller already has,
+    // text must then be valid UTF-8.
+    template <typename Callback>
+    void for_each_match(std::string_view text, Callback &&callback, bool utf8_validated = false) const
+    {
+        for_each_match_impl(text, [](void *context, size_t offset, size_t length) {
+            (*static_cast<std::remove_reference_t<Callback> *>(context))(offset, length);
+        }, &callback, utf8_validated);
+    }
 
 private:
+    void for_each_match_impl(std::string_view text, void (*callback)(void *, size_t, size_t), void *context,
+        bool utf8_validated) const;
+
     void* impl_state_;
 };
 
@@ -0,0 +1,87 @@
+#include "piece_cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace tiktoken
+{
+
+namespace
+{
+    size_t counter_stripe()
+    {
+        static std::atomic<size_t> next_stripe { 0 };
+        thread_local const size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+        return stripe;
+    }
+}
+
+PieceCache::PieceCache(size_t capacity) :
+    entries_(new entry_t[std::bit_floor(std::max<size_t>(capacity, 1))]),
+    mask_(std::bit_floor(std::max<size_t>(capacity, 1)) - 1) { }
+
+size_t PieceCache::find(std::span<const uint8_t> piece, uint64_t hash, int *tokens) const
+{
+    counters_t &counters = counters_[counter_stripe() % counter_stripes];
+    const entry_t &entry = entries_[hash & mask_];
+    // A sequence lock: the copy only counts if no write started or finished while it was taken.
+    const uint64_t sequence = entry.sequence.load(std::memory_order_acquire);
+    const uint64_t stored_hash = entry.hash.load(std::memory_order_relaxed);
+    uint64_t payload[payload_words];
+    for (size_t i = 0; i < payload_words; ++i) {
+        payload[i] = entry.payload[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const bool consistent = (sequence & 1) == 0 && entry.sequence.load(std::memory_order_relaxed) == sequence;
+
+    const auto *bytes = reinterpret_cast<const uint8_t *>(payload);
+    const size_t count = bytes[1];
+    if (!consistent || stored_hash != hash || bytes[0] != piece.size() || count == 0
+        || std::memcmp(bytes + payload_header_bytes, piece.data(), piece.size()) != 0) {
+        counters.misses.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    std::memcpy(tokens, bytes + payload_header_bytes + piece.size(), count * sizeof(int));
+    counters.hits.fetch_add(1, std::memory_order_relaxed);
+    return count;
+}
+
+void PieceCache::insert(std::span<const uint8_t> piece, uint64_t hash, std::span<const int> tokens)
+{
+    if (tokens.empty() || payload_header_bytes + piece.size() + tokens.size() * sizeof(int) > max_payload_bytes) {
+        return;
+    }
+    uint64_t payload[payload_words] = {};
+    auto *bytes = reinterpret_cast<uint8_t *>(payload);
+    bytes[0] = static_cast<uint8_t>(piece.size());
+    bytes[1] = static_cast<uint8_t>(tokens.size());
+    std::memcpy(bytes + payload_header_bytes, piece.data(), piece.size());
+    std::memcpy(bytes + payload_header_bytes + piece.size(), tokens.data(), tokens.size() * sizeof(int));
+
+    entry_t &entry = entries_[hash & mask_];
+    uint64_t sequence = entry.sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) != 0
+        || !entry.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.hash.store(hash, std::memory_order_relaxed);
+    for (size_t i = 0; i < payload_words; ++i) {
+        entry.payload[i].store(payload[i], std::memory_order_relaxed);
+    }
+    entry.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+PieceCacheStats PieceCache::stats() const
+{
+    PieceCacheStats stats;
+    for (const auto &counters: counters_) {
+        stats.hits += counters.hits.load(std::memory_order_relaxed);
+        stats.misses += counters.misses.load(std::memory_order_relaxed);
+    }
+    stats.capacity = capacity();
+    return stats;
+}
+
+}
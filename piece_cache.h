@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+namespace tiktoken
+{
+
+// What a piece cache has seen since it was made.
+struct PieceCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Entries, 0 when the cache is off.
+    size_t capacity = 0;
+};
+
+// A fixed number of entries mapping a short piece to its tokens, shared by every thread that encodes with one
+// encoding. A piece has exactly one slot, and storing it replaces whatever was there. Each entry is a cache line with
+// its own sequence counter, so a lookup only reads shared memory, and a store that finds its entry being written by
+// another thread is dropped.
+class PieceCache {
+public:
+    // An entry holds the piece size and the token count in a byte each, then the piece, then the tokens, in
+    // max_payload_bytes.
+    static constexpr size_t max_payload_bytes = 48;
+    static constexpr size_t payload_header_bytes = 2;
+    // Pieces longer than this are never cached: a longer one leaves no room for even a single token.
+    static constexpr size_t max_piece_size = max_payload_bytes - payload_header_bytes - sizeof(int);
+    // The most tokens an entry holds, which is what a piece of two bytes leaves room for.
+    static constexpr size_t max_cached_tokens = (max_payload_bytes - payload_header_bytes - 2) / sizeof(int);
+    static_assert(max_piece_size <= UINT8_MAX && max_cached_tokens <= UINT8_MAX);
+
+    // capacity is rounded down to a power of two, and up to at least one entry.
+    explicit PieceCache(size_t capacity);
+
+    // Copies the tokens of piece to tokens, which has room for max_cached_tokens of them, and returns how many there
+    // are, or 0 if piece is not cached. hash is rank_table_hash(piece).
+    size_t find(std::span<const uint8_t> piece, uint64_t hash, int *tokens) const;
+    // Stores tokens as the encoding of piece, if they fit in an entry.
+    void insert(std::span<const uint8_t> piece, uint64_t hash, std::span<const int> tokens);
+
+    [[nodiscard]] size_t capacity() const { return mask_ + 1; }
+    [[nodiscard]] PieceCacheStats stats() const;
+
+private:
+    static constexpr size_t payload_words = max_payload_bytes / sizeof(uint64_t);
+    // An entry is sequence, then hash, then the payload packed into payload_words words. An odd sequence means a
+    // write is in progress; size 0 means empty.
+    struct alignas(64) entry_t {
+        std::atomic<uint64_t> sequence { 0 };
+        std::atomic<uint64_t> hash { 0 };
+        std::atomic<uint64_t> payload[payload_words] {};
+    };
+    static_assert(sizeof(entry_t::payload) == max_payload_bytes && sizeof(entry_t) == 64);
+    // Threads count into different stripes, so that counting does not make every lookup write one shared line.
+    static constexpr size_t counter_stripes = 16;
+    struct alignas(64) counters_t {
+        std::atomic<uint64_t> hits { 0 };
+        std::atomic<uint64_t> misses { 0 };
+    };
+
+    std::unique_ptr<entry_t[]> entries_;
+    size_t mask_;
+    mutable counters_t counters_[counter_stripes];
+};
+
+}
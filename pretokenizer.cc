@@ -0,0 +1,409 @@
+#include "pretokenizer.h"
+#include "modelparams.h"
+#include "unicode_tables.h"
+
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TIKTOKEN_PRETOKENIZER_SSE2 1
+#endif
+
+namespace tiktoken
+{
+
+namespace
+{
+    // [\p{Lu}\p{Lt}\p{Lm}\p{Lo}\p{M}] and [\p{Ll}\p{Lm}\p{Lo}\p{M}] from the o200k pattern.
+    constexpr uint8_t o200k_upper = unicode::Lu | unicode::Lt | unicode::Lm | unicode::Lo | unicode::Mark;
+    constexpr uint8_t o200k_lower = unicode::Ll | unicode::Lm | unicode::Lo | unicode::Mark;
+
+    class text_t
+    {
+    public:
+        explicit text_t(std::string_view text) :
+            bytes_(reinterpret_cast<const uint8_t *>(text.data())),
+            size_(text.size())
+        {
+        }
+
+        [[nodiscard]] size_t size() const { return size_; }
+        [[nodiscard]] uint8_t byte(size_t offset) const { return bytes_[offset]; }
+
+        // Decodes the code point at offset, which must start a well-formed sequence before size().
+        uint32_t code_point(size_t offset, size_t &length) const
+        {
+            const uint8_t *p = bytes_ + offset;
+            if (p[0] < 0x80) {
+                length = 1;
+                return p[0];
+            }
+            if (p[0] < 0xE0) {
+                length = 2;
+                return ((p[0] & 0x1Fu) << 6) | (p[1] & 0x3Fu);
+            }
+            if (p[0] < 0xF0) {
+                length = 3;
+                return ((p[0] & 0x0Fu) << 12) | ((p[1] & 0x3Fu) << 6) | (p[2] & 0x3Fu);
+            }
+            length = 4;
+            return ((p[0] & 0x07u) << 18) | ((p[1] & 0x3Fu) << 12) | ((p[2] & 0x3Fu) << 6) | (p[3] & 0x3Fu);
+        }
+
+        uint8_t properties(size_t offset, size_t &length) const
+        {
+            return unicode::properties(code_point(offset, length));
+        }
+
+        [[nodiscard]] uint8_t properties(size_t offset) const
+        {
+            size_t length;
+            return properties(offset, length);
+        }
+
+        // Skips ASCII letters that belong to mask sixteen bytes at a time; everything else is left to the caller.
+        [[nodiscard]] size_t skip_ascii_letters(size_t offset, uint8_t mask) const
+        {
+#if defined(TIKTOKEN_PRETOKENIZER_SSE2)
+            const bool upper = (mask & unicode::Lu) != 0;
+            const bool lower = (mask & unicode::Ll) != 0;
+            if (!upper && !lower) {
+                return offset;
+            }
+            // Setting bit 5 folds A-Z onto a-z and maps no other byte into that range.
+            const __m128i fold = _mm_set1_epi8(upper && lower ? 0x20 : 0);
+            const __m128i first = _mm_set1_epi8(lower ? 'a' : 'A');
+            const __m128i last = _mm_set1_epi8(25);
+            for (; offset + 16 <= size_; offset += 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes_ + offset));
+                const __m128i index = _mm_sub_epi8(_mm_or_si128(block, fold), first);
+                const __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(index, last), index);
+                const unsigned mismatch = ~static_cast<unsigned>(_mm_movemask_epi8(in_range)) & 0xFFFFu;
+                if (mismatch != 0) {
+                    return offset + std::countr_zero(mismatch);
+                }
+            }
+#endif
+            return offset;
+        }
+
+        // End of the run of code points starting at offset whose properties intersect mask.
+        [[nodiscard]] size_t run_end(size_t offset, uint8_t mask) const
+        {
+            offset = skip_ascii_letters(offset, mask);
+            while (offset < size_) {
+                size_t length;
+                if (!(properties(offset, length) & mask)) {
+                    break;
+                }
+                offset += length;
+            }
+            return offset;
+        }
+
+        // End of the run of code points starting at offset whose properties do not intersect mask.
+        [[nodiscard]] size_t run_end_excluding(size_t offset, uint8_t mask) const
+        {
+            while (offset < size_) {
+                size_t length;
+                if (properties(offset, length) & mask) {
+                    break;
+                }
+                offset += length;
+            }
+            return offset;
+        }
+
+        // End of \p{N}{1,3}, or offset if there is no number at offset.
+        [[nodiscard]] size_t numbers_end(size_t offset) const
+        {
+            for (int count = 0; count < 3 && offset < size_; ++count) {
+                size_t length;
+                if (!(properties(offset, length) & unicode::Number)) {
+                    break;
+                }
+                offset += length;
+            }
+            return offset;
+        }
+
+        // Length of (?i:'s|'t|'re|'ve|'m|'ll|'d) at offset, or 0. Under caseless matching s also matches U+017F.
+        [[nodiscard]] size_t contraction_length(size_t offset) const
+        {
+            if (offset + 1 >= size_ || bytes_[offset] != '\'') {
+                return 0;
+            }
+            const auto folded = [this](size_t at) -> uint32_t {
+                if (at >= size_) {
+                    return 0;
+                }
+                size_t length;
+                const uint32_t c = code_point(at, length);
+                return c == 0x17F ? 's' : (c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+            };
+            switch (folded(offset + 1)) {
+                case 's':
+                    return bytes_[offset + 1] < 0x80 ? 2 : 3;
+                case 't':
+                case 'm':
+                case 'd':
+                    return 2;
+                case 'r':
+                case 'v':
+                    return folded(offset + 2) == 'e' ? 3 : 0;
+                case 'l':
+                    return folded(offset + 2) == 'l' ? 3 : 0;
+                default:
+                    return 0;
+            }
+        }
+
+        // End of \s*[\r\n]+ (when newlines is set), then \s+(?!\S), then \s+ at offset, or offset if it is not space.
+        [[nodiscard]] size_t whitespace_end(size_t offset, bool newlines) const
+        {
+            size_t end = offset;
+            size_t last_start = offset;
+            size_t newline_end = offset;
+            while (end < size_) {
+                size_t length;
+                if (!(properties(end, length) & unicode::Space)) {
+                    break;
+                }
+                if (bytes_[end] == '\r' || bytes_[end] == '\n') {
+                    newline_end = end + 1;
+                }
+                last_start = end;
+                end += length;
+            }
+            if (end == offset) {
+                return offset;
+            }
+            if (newlines && newline_end != offset) {
+                return newline_end;
+            }
+            // (?!\S) holds at the end of the text; otherwise give the last space back to the next piece when the
+            // run has more than one character.
+            if (end == size_ || last_start == offset) {
+                return end;
+            }
+            return last_start;
+        }
+
+    private:
+        const uint8_t *bytes_;
+        size_t size_;
+    };
+
+    // [^\r\n\p{L}\p{N}]? is tried with the optional character first, then without it.
+    struct optional_prefix_t
+    {
+        size_t starts[2];
+        int count;
+    };
+
+    optional_prefix_t optional_prefix(const text_t &text, size_t offset, bool has_prefix, size_t prefix_length)
+    {
+        if (has_prefix && offset + prefix_length < text.size()) {
+            return { { offset + prefix_length, offset }, 2 };
+        }
+        return { { offset, offset }, 1 };
+    }
+
+    bool is_letter_prefix(uint32_t c, uint8_t properties)
+    {
+        return c != '\r' && c != '\n' && !(properties & (unicode::Letter | unicode::Number));
+    }
+
+    // ' ?[^\s\p{L}\p{N}]+' followed by as many of trailing as possible, or offset if there is no match.
+    size_t punctuation_end(const text_t &text, size_t offset, std::string_view trailing)
+    {
+        constexpr uint8_t not_punctuation = unicode::Space | unicode::Letter | unicode::Number;
+        const auto prefix = optional_prefix(text, offset, text.byte(offset) == ' ', 1);
+        for (int i = 0; i < prefix.count; ++i) {
+            const size_t start = prefix.starts[i];
+            if (text.properties(start) & not_punctuation) {
+                continue;
+            }
+            size_t end = text.run_end_excluding(start, not_punctuation);
+            while (end < text.size() && trailing.find(static_cast<char>(text.byte(end))) != std::string_view::npos) {
+                ++end;
+            }
+            return end;
+        }
+        return offset;
+    }
+
+    // [^\r\n\p{L}\p{N}]?[\p{Lu}\p{Lt}\p{Lm}\p{Lo}\p{M}]*[\p{Ll}\p{Lm}\p{Lo}\p{M}]+(?i:'s|'t|'re|'ve|'m|'ll|'d)?
+    // |[^\r\n\p{L}\p{N}]?[\p{Lu}\p{Lt}\p{Lm}\p{Lo}\p{M}]+[\p{Ll}\p{Lm}\p{Lo}\p{M}]*(?i:'s|'t|'re|'ve|'m|'ll|'d)?
+    // |\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n/]*|\s*[\r\n]+|\s+(?!\S)|\s+
+    size_t match_o200k(const text_t &text, size_t offset)
+    {
+        size_t first_length;
+        const uint32_t first = text.code_point(offset, first_length);
+        const uint8_t first_properties = unicode::properties(first);
+        const auto prefix = optional_prefix(text, offset, is_letter_prefix(first, first_properties), first_length);
+
+        for (int i = 0; i < prefix.count; ++i) {
+            // The upper-case run gives characters back until the lower-case run can start, so the lower-case run
+            // starts either right after the upper-case run or at the last character of it that is also lower-case.
+            size_t upper_end = prefix.starts[i];
+            size_t last_lower = text.size();
+            while (upper_end < text.size()) {
+                size_t length;
+                const uint8_t properties = text.properties(upper_end, length);
+                if (!(properties & o200k_upper)) {
+                    break;
+                }
+                if (properties & o200k_lower) {
+                    last_lower = upper_end;
+                }
+                upper_end += length;
+            }
+            size_t lower_start = last_lower;
+            if (upper_end < text.size() && (text.properties(upper_end) & o200k_lower)) {
+                lower_start = upper_end;
+            }
+            if (lower_start < text.size()) {
+                const size_t end = text.run_end(lower_start, o200k_lower);
+                return end + text.contraction_length(end) - offset;
+            }
+        }
+        for (int i = 0; i < prefix.count; ++i) {
+            const size_t start = prefix.starts[i];
+            if (text.properties(start) & o200k_upper) {
+                const size_t end = text.run_end(text.run_end(start, o200k_upper), o200k_lower);
+                return end + text.contraction_length(end) - offset;
+            }
+        }
+        if (first_properties & unicode::Number) {
+            return text.numbers_end(offset) - offset;
+        }
+        if (const size_t end = punctuation_end(text, offset, "\r\n/"); end != offset) {
+            return end - offset;
+        }
+        if (const size_t end = text.whitespace_end(offset, true); end != offset) {
+            return end - offset;
+        }
+        return first_length;
+    }
+
+    // (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+
+    size_t match_cl100k(const text_t &text, size_t offset)
+    {
+        if (const size_t length = text.contraction_length(offset)) {
+            return length;
+        }
+        size_t first_length;
+        const uint32_t first = text.code_point(offset, first_length);
+        const uint8_t first_properties = unicode::properties(first);
+        const auto prefix = optional_prefix(text, offset, is_letter_prefix(first, first_properties), first_length);
+        for (int i = 0; i < prefix.count; ++i) {
+            if (text.properties(prefix.starts[i]) & unicode::Letter) {
+                return text.run_end(prefix.starts[i], unicode::Letter) - offset;
+            }
+        }
+        if (first_properties & unicode::Number) {
+            return text.numbers_end(offset) - offset;
+        }
+        if (const size_t end = punctuation_end(text, offset, "\r\n"); end != offset) {
+            return end - offset;
+        }
+        if (const size_t end = text.whitespace_end(offset, true); end != offset) {
+            return end - offset;
+        }
+        return first_length;
+    }
+
+    // 's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+    size_t match_p50k(const text_t &text, size_t offset)
+    {
+        if (const size_t length = text.contraction_length(offset)) {
+            return length;
+        }
+        const auto prefix = optional_prefix(text, offset, text.byte(offset) == ' ', 1);
+        for (const uint8_t mask: { unicode::Letter, unicode::Number }) {
+            for (int i = 0; i < prefix.count; ++i) {
+                if (text.properties(prefix.starts[i]) & mask) {
+                    return text.run_end(prefix.starts[i], mask) - offset;
+                }
+            }
+        }
+        if (const size_t end = punctuation_end(text, offset, ""); end != offset) {
+            return end - offset;
+        }
+        if (const size_t end = text.whitespace_end(offset, false); end != offset) {
+            return end - offset;
+        }
+        size_t first_length;
+        text.code_point(offset, first_length);
+        return first_length;
+    }
+}
+
+PreTokenizerPattern find_pre_tokenizer_pattern(std::string_view pattern)
+{
+    if (pattern == ModelParamsGenerator::get_pattern(LanguageModel::O200K_BASE)) {
+        return PreTokenizerPattern::O200K;
+    }
+    if (pattern == ModelParamsGenerator::get_pattern(LanguageModel::CL100K_BASE)) {
+        return PreTokenizerPattern::CL100K;
+    }
+    if (pattern == ModelParamsGenerator::get_pattern(LanguageModel::P50K_BASE)) {
+        return PreTokenizerPattern::P50K;
+    }
+    return PreTokenizerPattern::None;
+}
+
+size_t match_pre_token(PreTokenizerPattern pattern, std::string_view text, size_t offset)
+{
+    const text_t view(text);
+    switch (pattern) {
+        case PreTokenizerPattern::O200K:
+            return match_o200k(view, offset);
+        case PreTokenizerPattern::CL100K:
+            return match_cl100k(view, offset);
+        case PreTokenizerPattern::P50K:
+            return match_p50k(view, offset);
+        case PreTokenizerPattern::None:
+            break;
+    }
+    return text.size() - offset;
+}
+
+size_t find_pre_token_boundary(PreTokenizerPattern pattern, std::string_view text, size_t from)
+{
+    // No piece of any bundled pattern runs on from a code point that is not \s into an ASCII space, or from a letter
+    // into a code point that is not a letter, number, mark, space or apostrophe; the apostrophe would start a
+    // contraction, and o200k keeps marks with the letters before them. A piece always ends at such a point, and
+    // where it ends does not depend on what follows, as the only lookahead, (?!\S), is in pieces of \s alone.
+    if (pattern == PreTokenizerPattern::None) {
+        return text.size();
+    }
+    const text_t view(text);
+    while (from < text.size() && (view.byte(from) & 0xC0) == 0x80) {
+        ++from;
+    }
+    size_t offset = from;
+    uint8_t previous = 0;
+    bool has_previous = false;
+    while (offset < text.size()) {
+        size_t length;
+        const uint32_t code_point = view.code_point(offset, length);
+        const uint8_t current = unicode::properties(code_point);
+        if (has_previous && offset > 0) {
+            if (code_point == ' ' && !(previous & unicode::Space)) {
+                return offset;
+            }
+            if ((previous & unicode::Letter) && code_point != '\''
+                && !(current & (unicode::Letter | unicode::Number | unicode::Mark | unicode::Space))) {
+                return offset;
+            }
+        }
+        previous = current;
+        has_previous = true;
+        offset += length;
+    }
+    return text.size();
+}
+
+}
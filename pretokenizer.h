@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+#include <string_view>
+
+namespace tiktoken
+{
+
+// Pre-tokenizer patterns that have a hand-written matcher. Each matcher produces exactly the pieces PCRERegex produces
+// for the ModelParamsGenerator pattern of the same name compiled with PCRE2_CASELESS, which is how GptEncoding
+// compiles it, but without going through a backtracking regex engine.
+enum class PreTokenizerPattern {
+    None,
+    O200K,
+    CL100K,
+    P50K
+};
+
+// The hand-written equivalent of pattern, or None if pattern has to be matched by PCRERegex.
+PreTokenizerPattern find_pre_tokenizer_pattern(std::string_view pattern);
+
+// Length of the piece that starts at offset. text must be valid UTF-8 and offset must be less than text.size().
+size_t match_pre_token(PreTokenizerPattern pattern, std::string_view text, size_t offset);
+
+// The first offset after from, and after 0, where text can be cut so that pre-tokenizing the two parts on their own
+// gives the same pieces as pre-tokenizing text whole, or text.size() if there is none. text must be valid UTF-8. For
+// None no offset is known to be safe, so the result is always text.size().
+size_t find_pre_token_boundary(PreTokenizerPattern pattern, std::string_view text, size_t from);
+
+// Calls callback(offset, length) for every piece of text, which must be valid UTF-8, like PCRERegex::for_each_match.
+template <typename Callback>
+void for_each_pre_token(PreTokenizerPattern pattern, std::string_view text, Callback &&callback)
+{
+    size_t offset = 0;
+    while (offset < text.size()) {
+        const size_t length = match_pre_token(pattern, text, offset);
+        callback(offset, length);
+        offset += length;
+    }
+}
+
+}
@@ -0,0 +1,251 @@
+#include "rank_table.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TIKTOKEN_PREFETCH(address) __builtin_prefetch(address)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define TIKTOKEN_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char *>(address), _MM_HINT_T0)
+#else
+#define TIKTOKEN_PREFETCH(address) ((void) (address))
+#endif
+
+namespace tiktoken
+{
+
+namespace
+{
+    const uint32_t empty_offsets[1] = { 0 };
+    const RankTable::Slot empty_slots[1] = { 0 };
+
+    struct rank_table_storage_t
+    {
+        tt_stl::vector<uint32_t> offsets;
+        tt_stl::vector<RankTable::Slot> slots;
+        tt_stl::vector<uint8_t> bytes;
+    };
+
+    // How many entries ahead of the one being inserted build prefetches the home slot of.
+    constexpr size_t prefetch_distance = 16;
+    // Fewer entries than this are hashed by the calling thread alone.
+    constexpr size_t min_parallel_hash_entries = 64 * 1024;
+}
+
+RankTable::RankTable() :
+    token_count_(0),
+    slot_count_(1),
+    offsets_(empty_offsets),
+    slots_(empty_slots),
+    bytes_(nullptr)
+{
+}
+
+RankTable::RankTable(uint32_t token_count, const uint32_t *offsets, uint32_t slot_count, const Slot *slots,
+    const uint8_t *bytes, std::shared_ptr<const void> owner) :
+    owner_(std::move(owner)),
+    token_count_(token_count),
+    slot_count_(slot_count),
+    offsets_(offsets),
+    slots_(slots),
+    bytes_(bytes)
+{
+}
+
+RankTable::RankTable(const bpe_encoding_t &ranks) :
+    RankTable()
+{
+    Builder builder;
+    size_t byte_size = 0;
+    for (const auto &byte_pair: ranks) {
+        byte_size += byte_pair.first.size();
+    }
+    builder.reserve(ranks.size(), byte_size);
+    for (const auto &byte_pair: ranks) {
+        builder.add(byte_pair.first, byte_pair.second);
+    }
+    *this = builder.build();
+}
+
+void RankTable::Builder::reserve(size_t token_count, size_t byte_size)
+{
+    entries_.reserve(token_count);
+    bytes_.reserve(byte_size);
+}
+
+void RankTable::Builder::add(std::span<const uint8_t> bytes, int rank)
+{
+    if (rank < 0 || static_cast<uint32_t>(rank) >= MaxTokenCount
+        || bytes_.size() + bytes.size() > std::numeric_limits<uint32_t>::max()) {
+        return;
+    }
+    entries_.push_back({ static_cast<uint32_t>(rank), static_cast<uint32_t>(bytes_.size()),
+        static_cast<uint32_t>(bytes.size()) });
+    bytes_.insert(bytes_.end(), bytes.begin(), bytes.end());
+}
+
+void RankTable::Builder::append(Builder &&other)
+{
+    if (bytes_.size() + other.bytes_.size() > std::numeric_limits<uint32_t>::max()) {
+        other.entries_.clear();
+        other.bytes_.clear();
+        return;
+    }
+    const auto shift = static_cast<uint32_t>(bytes_.size());
+    entries_.reserve(entries_.size() + other.entries_.size());
+    for (const auto &entry: other.entries_) {
+        entries_.push_back({ entry.rank, entry.offset + shift, entry.size });
+    }
+    bytes_.insert(bytes_.end(), other.bytes_.begin(), other.bytes_.end());
+    other.entries_.clear();
+    other.bytes_.clear();
+}
+
+RankTable RankTable::Builder::build(IExecutor *executor)
+{
+    if (entries_.empty()) {
+        bytes_.clear();
+        return RankTable();
+    }
+
+    // Vocabulary files list ranks in order, so the common case keeps the bytes where they are.
+    bool in_rank_order = true;
+    for (size_t i = 1; i < entries_.size() && in_rank_order; ++i) {
+        in_rank_order = entries_[i - 1].rank < entries_[i].rank;
+    }
+    if (!in_rank_order) {
+        std::stable_sort(entries_.begin(), entries_.end(),
+            [](const entry_t &a, const entry_t &b) { return a.rank < b.rank; });
+    }
+
+    const uint32_t token_count = entries_.back().rank + 1;
+    const uint32_t slot_count = slot_count_for(token_count);
+    auto storage = std::make_shared<rank_table_storage_t>();
+    storage->offsets.reserve(token_count + 1);
+    storage->slots.assign(slot_count, 0);
+    if (in_rank_order) {
+        storage->bytes = std::move(bytes_);
+    } else {
+        storage->bytes.reserve(bytes_.size());
+    }
+
+    // Hashing every entry up front lets the insert loop prefetch the slot it probes a few entries ahead, which hides
+    // most of the cache misses into an index larger than the cache. The hashes are independent of each other, so
+    // a large table shares them out over executor.
+    tt_stl::vector<uint64_t> hashes(entries_.size());
+    const uint8_t *source = in_rank_order ? storage->bytes.data() : bytes_.data();
+    const auto hash_entries = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            hashes[i] = rank_table_hash({ source + entries_[i].offset, entries_[i].size });
+        }
+    };
+    if (executor && entries_.size() >= min_parallel_hash_entries && executor->concurrency() > 1) {
+        const size_t task_count = executor->concurrency();
+        executor->run(task_count, [&](size_t task) {
+            hash_entries(entries_.size() * task / task_count, entries_.size() * (task + 1) / task_count);
+        });
+    } else {
+        hash_entries(0, entries_.size());
+    }
+
+    const auto insert = [&](uint32_t rank, uint32_t offset, uint32_t size, uint64_t hash) {
+        const std::span<const uint8_t> bytes(storage->bytes.data() + offset, size);
+        const uint32_t tag = static_cast<uint32_t>(hash >> 56);
+        uint32_t index = home_slot(hash, slot_count);
+        for (; storage->slots[index] != 0; index = index + 1 == slot_count ? 0 : index + 1) {
+            const Slot slot = storage->slots[index];
+            if ((slot >> 24) == tag) {
+                const uint32_t other = (slot & MaxTokenCount) - 1;
+                const uint32_t begin = storage->offsets[other];
+                if (storage->offsets[other + 1] - begin == size
+                    && std::memcmp(storage->bytes.data() + begin, bytes.data(), size) == 0) {
+                    return false;
+                }
+            }
+        }
+        storage->slots[index] = make_slot(hash, rank);
+        return true;
+    };
+
+    // Inserting in rank order makes the index layout deterministic, the same as the converter script produces.
+    uint32_t end = 0;
+    size_t next = 0;
+    for (uint32_t rank = 0; rank < token_count; ++rank) {
+        storage->offsets.push_back(end);
+        if (entries_[next].rank != rank) {
+            continue;
+        }
+        const entry_t entry = entries_[next];
+        const uint64_t hash = hashes[next];
+        if (next + prefetch_distance < hashes.size()) {
+            TIKTOKEN_PREFETCH(&storage->slots[home_slot(hashes[next + prefetch_distance], slot_count)]);
+        }
+        while (next < entries_.size() && entries_[next].rank == rank) {
+            ++next;
+        }
+        // Bytes go at end, closing up the space of any duplicate that was dropped.
+        if (in_rank_order) {
+            std::memmove(storage->bytes.data() + end, storage->bytes.data() + entry.offset, entry.size);
+        } else {
+            storage->bytes.resize(end);
+            storage->bytes.insert(storage->bytes.end(), bytes_.begin() + entry.offset,
+                bytes_.begin() + entry.offset + entry.size);
+        }
+        if (insert(rank, end, entry.size, hash)) {
+            end += entry.size;
+        }
+    }
+    storage->offsets.push_back(end);
+    storage->bytes.resize(end);
+    entries_.clear();
+    bytes_.clear();
+
+    RankTable table(token_count, storage->offsets.data(), slot_count, storage->slots.data(), storage->bytes.data(),
+        nullptr);
+    table.owner_ = std::move(storage);
+    return table;
+}
+
+bpe_encoding_t RankTable::to_map() const
+{
+    bpe_encoding_t ranks;
+    ranks.reserve(token_count_);
+    for (uint32_t rank = 0; rank < token_count_; ++rank) {
+        const auto token = bytes(static_cast<int>(rank));
+        if (!token.empty()) {
+            ranks.emplace(tt_stl::vector<uint8_t>(token.begin(), token.end()), static_cast<int>(rank));
+        }
+    }
+    return ranks;
+}
+
+bool RankTable::is_valid(uint32_t token_count, const uint32_t *offsets, uint32_t slot_count, const Slot *slots,
+    size_t byte_size)
+{
+    if (token_count > MaxTokenCount || slot_count == 0 || offsets[0] != 0 || offsets[token_count] > byte_size) {
+        return false;
+    }
+    for (uint32_t rank = 0; rank < token_count; ++rank) {
+        if (offsets[rank] > offsets[rank + 1]) {
+            return false;
+        }
+    }
+    bool has_empty_slot = false;
+    for (uint32_t index = 0; index < slot_count; ++index) {
+        const uint32_t rank = slots[index] & MaxTokenCount;
+        if (rank > token_count || (rank == 0 && slots[index] != 0)) {
+            return false;
+        }
+        has_empty_slot = has_empty_slot || slots[index] == 0;
+    }
+    return has_empty_slot;
+}
+
+uint32_t RankTable::slot_count_for(uint32_t token_count)
+{
+    return token_count + token_count / 3 + 1;
+}
+
+}
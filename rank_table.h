@@ -0,0 +1,164 @@
+#pragma once
+
+#include "common.h"
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <span>
+
+namespace tiktoken
+{
+
+class IExecutor;
+
+// The hash RankTable is indexed by. tools/tiktoken_to_binary.py implements the same function, so the tables it writes
+// can be searched in place.
+inline uint64_t rank_table_hash(std::span<const uint8_t> bytes)
+{
+    constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    const auto mix = [](uint64_t hash, uint64_t word) {
+        hash = (hash ^ word) * multiplier;
+        return hash ^ (hash >> 32);
+    };
+    const auto load32 = [](const uint8_t *p) {
+        uint32_t word;
+        std::memcpy(&word, p, sizeof(word));
+        if constexpr (std::endian::native != std::endian::little) {
+            word = (word >> 24) | ((word >> 8) & 0xFF00u) | ((word << 8) & 0xFF0000u) | (word << 24);
+        }
+        return word;
+    };
+    const auto load64 = [&load32](const uint8_t *p) {
+        return load32(p) | static_cast<uint64_t>(load32(p + 4)) << 32;
+    };
+    // The last 1 to 7 bytes as a little-endian word, built from fixed-size loads since a memcpy of variable size
+    // would be a library call.
+    const auto load_tail = [&load32](const uint8_t *p, size_t size) -> uint64_t {
+        if (size >= 4) {
+            const uint64_t low = load32(p);
+            return size == 4 ? low : low | static_cast<uint64_t>(load32(p + size - 4) >> (8 * (8 - size))) << 32;
+        }
+        return p[0] | static_cast<uint64_t>(p[size >> 1]) << (8 * (size >> 1))
+            | static_cast<uint64_t>(p[size - 1]) << (8 * (size - 1));
+    };
+
+    uint64_t hash = bytes.size() * 0xFF51AFD7ED558CCDull;
+    size_t offset = 0;
+    for (; offset + 8 <= bytes.size(); offset += 8) {
+        hash = mix(hash, load64(bytes.data() + offset));
+    }
+    if (offset < bytes.size()) {
+        hash = mix(hash, load_tail(bytes.data() + offset, bytes.size() - offset));
+    }
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    return hash ^ (hash >> 32);
+}
+
+// Byte pair ranks in flat arrays: the bytes of every rank back to back in rank order, and an open-addressing index
+// from hashed bytes to rank. The arrays are either owned by the table or a view of memory that owner keeps alive,
+// such as a mapped vocabulary file or a vocabulary compiled into the library.
+class RankTable {
+public:
+    // Each slot packs the top 8 bits of the hash above rank + 1; an empty slot is 0. Ranks therefore stay below
+    // MaxTokenCount, which is far more than any vocabulary needs.
+    using Slot = uint32_t;
+    static constexpr uint32_t MaxTokenCount = (1u << 24) - 1;
+
+    // Collects ranks in any order, such as from a .tiktoken file, and lays them out as a table. Where the same
+    // bytes or the same rank is added twice, the first one added is kept.
+    class Builder {
+    public:
+        void reserve(size_t token_count, size_t byte_size);
+        void add(std::span<const uint8_t> bytes, int rank);
+        // Adds everything other collected, as if each had been added here in turn, and leaves other empty.
+        void append(Builder &&other);
+        [[nodiscard]] size_t size() const { return entries_.size(); }
+        // Leaves the builder empty. Given an executor, a large table hashes its entries on it.
+        RankTable build(IExecutor *executor = nullptr);
+
+    private:
+        struct entry_t {
+            uint32_t rank;
+            uint32_t offset;
+            uint32_t size;
+        };
+        tt_stl::vector<entry_t> entries_;
+        tt_stl::vector<uint8_t> bytes_;
+    };
+
+    RankTable();
+    explicit RankTable(const bpe_encoding_t &ranks);
+    // offsets holds token_count + 1 entries; see is_valid.
+    RankTable(uint32_t token_count, const uint32_t *offsets, uint32_t slot_count, const Slot *slots,
+        const uint8_t *bytes, std::shared_ptr<const void> owner);
+
+    // Checks arrays from an untrusted source: offsets must not decrease or run past byte_size, the length of the
+    // bytes array, which may be longer than the tokens need; every slot must name an existing rank, and at least one
+    // slot must be empty so that a search terminates.
+    static bool is_valid(uint32_t token_count, const uint32_t *offsets, uint32_t slot_count, const Slot *slots,
+        size_t byte_size);
+    // Index size used for token_count ranks, which keeps the load factor at or below 3/4.
+    static uint32_t slot_count_for(uint32_t token_count);
+    // The slot a search for hash starts at. Scaling the low half of the hash avoids rounding the index up to a
+    // power of two.
+    static uint32_t home_slot(uint64_t hash, uint32_t slot_count)
+    {
+        return static_cast<uint32_t>((static_cast<uint32_t>(hash) * static_cast<uint64_t>(slot_count)) >> 32);
+    }
+    static Slot make_slot(uint64_t hash, uint32_t rank)
+    {
+        return static_cast<uint32_t>(hash >> 56) << 24 | (rank + 1);
+    }
+
+    // The rank of bytes, or -1 if they have none.
+    [[nodiscard]] int find(std::span<const uint8_t> bytes) const { return find(bytes, rank_table_hash(bytes)); }
+    // find for a caller that already has rank_table_hash(bytes).
+    [[nodiscard]] int find(std::span<const uint8_t> bytes, uint64_t hash) const
+    {
+        const uint32_t tag = static_cast<uint32_t>(hash >> 56);
+        for (uint32_t index = home_slot(hash, slot_count_);; index = index + 1 == slot_count_ ? 0 : index + 1) {
+            const Slot slot = slots_[index];
+            if (slot == 0) {
+                return -1;
+            }
+            if ((slot >> 24) == tag) {
+                const uint32_t rank = (slot & MaxTokenCount) - 1;
+                const uint32_t begin = offsets_[rank];
+                const uint32_t end = offsets_[rank + 1];
+                if (end - begin == bytes.size() && std::memcmp(bytes_ + begin, bytes.data(), bytes.size()) == 0) {
+                    return static_cast<int>(rank);
+                }
+            }
+        }
+    }
+
+    // The bytes of rank, empty if rank is out of range or unused.
+    [[nodiscard]] std::span<const uint8_t> bytes(int rank) const
+    {
+        if (static_cast<uint32_t>(rank) >= token_count_) {
+            return {};
+        }
+        return { bytes_ + offsets_[rank], offsets_[rank + 1] - offsets_[rank] };
+    }
+
+    // The ranks as a map from bytes to rank, built on each call.
+    [[nodiscard]] bpe_encoding_t to_map() const;
+    // One more than the highest rank.
+    [[nodiscard]] uint32_t token_count() const { return token_count_; }
+    [[nodiscard]] uint32_t slot_count() const { return slot_count_; }
+    [[nodiscard]] const uint32_t *offsets() const { return offsets_; }
+    [[nodiscard]] const Slot *slots() const { return slots_; }
+    [[nodiscard]] const uint8_t *byte_data() const { return bytes_; }
+    [[nodiscard]] size_t byte_size() const { return offsets_[token_count_]; }
+
+private:
+    std::shared_ptr<const void> owner_;
+    uint32_t token_count_;
+    uint32_t slot_count_;
+    const uint32_t *offsets_;
+    const Slot *slots_;
+    const uint8_t *bytes_;
+};
+
+}
@@ -0,0 +1,26 @@
+#include "scratch_memory.h"
+
+namespace tiktoken
+{
+
+namespace
+{
+    thread_local std::pmr::memory_resource *current_resource = nullptr;
+}
+
+std::pmr::memory_resource *scratch_memory_resource()
+{
+    return current_resource ? current_resource : std::pmr::get_default_resource();
+}
+
+ScratchMemoryScope::ScratchMemoryScope(std::pmr::memory_resource *resource) : previous_(current_resource)
+{
+    current_resource = resource;
+}
+
+ScratchMemoryScope::~ScratchMemoryScope()
+{
+    current_resource = previous_;
+}
+
+}
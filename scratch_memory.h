@@ -0,0 +1,34 @@
+#pragma once
+
+#include "common.h"
+#include <memory_resource>
+#include <vector>
+
+namespace tiktoken
+{
+
+// Where encode and decode calls on the current thread take their temporary buffers from: the resource of the
+// innermost ScratchMemoryScope, or std::pmr::get_default_resource() outside of any.
+std::pmr::memory_resource *scratch_memory_resource();
+
+// A vector of temporaries from scratch_memory_resource().
+template <typename T>
+using scratch_vector = std::pmr::vector<T>;
+
+// Sends the temporary buffers of encode and decode calls made on this thread to resource until the scope ends, for
+// example a std::pmr::monotonic_buffer_resource that lives as long as one request. Scopes nest. Work that batch and
+// parallel calls hand to other threads uses those threads' scratch memory, so resource need not be thread-safe.
+// What calls return to the caller is never taken from resource.
+class ScratchMemoryScope {
+public:
+    explicit ScratchMemoryScope(std::pmr::memory_resource *resource);
+    ~ScratchMemoryScope();
+
+    ScratchMemoryScope(const ScratchMemoryScope &) = delete;
+    ScratchMemoryScope &operator=(const ScratchMemoryScope &) = delete;
+
+private:
+    std::pmr::memory_resource *previous_;
+};
+
+}
@@ -0,0 +1,180 @@
+#include "special_token_matcher.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <deque>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TIKTOKEN_SPECIALS_SSE2 1
+#endif
+
+namespace tiktoken
+{
+
+namespace
+{
+    constexpr uint32_t no_state = UINT32_MAX;
+}
+
+SpecialTokenMatcher::SpecialTokenMatcher(const tt_stl::unordered_map<tt_stl::string, int> &special_tokens)
+{
+    bool first_token = true;
+    for (const auto &[token, id]: special_tokens) {
+        if (token.empty()) {
+            continue;
+        }
+        for (const char byte: token) {
+            uint16_t &byte_class = byte_class_[static_cast<uint8_t>(byte)];
+            if (byte_class == 0) {
+                byte_class = static_cast<uint16_t>(class_count_++);
+            }
+        }
+        if (first_token) {
+            prefix_ = token.substr(0, 2);
+            first_token = false;
+        } else {
+            size_t common = 0;
+            while (common < prefix_.size() && common < token.size() && prefix_[common] == token[common]) {
+                ++common;
+            }
+            prefix_.resize(common);
+        }
+    }
+
+    // Build the trie, then fill in the missing transitions breadth first from the failure links.
+    transitions_.assign(class_count_, no_state);
+    for (const auto &[token, id]: special_tokens) {
+        if (token.empty()) {
+            continue;
+        }
+        uint32_t state = 0;
+        for (const char byte: token) {
+            uint32_t &next = transitions_[state * class_count_ + byte_class_[static_cast<uint8_t>(byte)]];
+            if (next == no_state) {
+                next = static_cast<uint32_t>(depth_.size());
+                transitions_.resize(transitions_.size() + class_count_, no_state);
+                depth_.push_back(depth_[state] + 1);
+                match_length_.push_back(0);
+                match_token_.push_back(0);
+            }
+            state = transitions_[state * class_count_ + byte_class_[static_cast<uint8_t>(byte)]];
+        }
+        match_length_[state] = static_cast<uint32_t>(token.size());
+        match_token_[state] = id;
+        max_length_ = std::max(max_length_, static_cast<uint32_t>(token.size()));
+    }
+
+    tt_stl::vector<uint32_t> failure(depth_.size(), 0);
+    std::deque<uint32_t> queue;
+    for (uint32_t byte_class = 0; byte_class < class_count_; ++byte_class) {
+        uint32_t &next = transitions_[byte_class];
+        if (next == no_state) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+    while (!queue.empty()) {
+        const uint32_t state = queue.front();
+        queue.pop_front();
+        // A token that is not itself a suffix match here may still end here as a suffix of a longer prefix.
+        if (match_length_[state] == 0) {
+            match_length_[state] = match_length_[failure[state]];
+            match_token_[state] = match_token_[failure[state]];
+        }
+        for (uint32_t byte_class = 0; byte_class < class_count_; ++byte_class) {
+            uint32_t &next = transitions_[state * class_count_ + byte_class];
+            const uint32_t fallback = transitions_[failure[state] * class_count_ + byte_class];
+            if (next == no_state) {
+                next = fallback;
+            } else {
+                failure[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+size_t SpecialTokenMatcher::skip_to_candidate(std::string_view text, size_t from) const
+{
+    if (prefix_.empty()) {
+        return from;
+    }
+    const char *const data = text.data();
+    if (prefix_.size() == 2) {
+#if defined(TIKTOKEN_SPECIALS_SSE2)
+        const __m128i first = _mm_set1_epi8(prefix_[0]);
+        const __m128i second = _mm_set1_epi8(prefix_[1]);
+        for (; from + 17 <= text.size(); from += 16) {
+            const __m128i at = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+            const __m128i after = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from + 1));
+            const int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(at, first), _mm_cmpeq_epi8(after, second)));
+            if (mask != 0) {
+                return from + std::countr_zero(static_cast<unsigned>(mask));
+            }
+        }
+#endif
+        while (from + 1 < text.size()) {
+            const void *found = std::memchr(data + from, prefix_[0], text.size() - from - 1);
+            if (!found) {
+                break;
+            }
+            from = static_cast<const char *>(found) - data;
+            if (data[from + 1] == prefix_[1]) {
+                return from;
+            }
+            ++from;
+        }
+        return text.size();
+    }
+    const void *found = std::memchr(data + from, prefix_[0], text.size() - from);
+    return found ? static_cast<const char *>(found) - data : text.size();
+}
+
+SpecialTokenMatcher::Match SpecialTokenMatcher::find(std::string_view text, size_t from) const
+{
+    Match best { std::string_view::npos, 0, 0 };
+    uint32_t state = 0;
+    size_t offset = from;
+    while (offset < text.size()) {
+        if (state == 0) {
+            if (best.offset != std::string_view::npos) {
+                break;
+            }
+            offset = skip_to_candidate(text, offset);
+            if (offset >= text.size()) {
+                break;
+            }
+        }
+        state = transitions_[state * class_count_ + byte_class_[static_cast<uint8_t>(text[offset])]];
+        ++offset;
+        // Any later match starts at offset - depth_[state] or after, so once that is past the best match
+        // nothing can start further left or at the same place and be longer.
+        if (best.offset != std::string_view::npos && offset - depth_[state] > best.offset) {
+            break;
+        }
+        if (const uint32_t length = match_length_[state]) {
+            const size_t start = offset - length;
+            if (best.offset == std::string_view::npos || start < best.offset
+                || (start == best.offset && length > best.length)) {
+                best = { start, length, match_token_[state] };
+            }
+        }
+    }
+    return best;
+}
+
+size_t SpecialTokenMatcher::partial_match_length(std::string_view text) const
+{
+    // The state after the last byte is the longest suffix that is a path in the trie, and no path is longer than the
+    // longest token.
+    uint32_t state = 0;
+    for (size_t offset = text.size() - std::min<size_t>(text.size(), max_length_); offset < text.size(); ++offset) {
+        state = transitions_[state * class_count_ + byte_class_[static_cast<uint8_t>(text[offset])]];
+    }
+    return depth_[state];
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.h"
+#include <array>
+#include <string_view>
+
+namespace tiktoken
+{
+
+// Finds special tokens in text with a single Aho-Corasick automaton over all of them, instead of one search per token.
+class SpecialTokenMatcher {
+public:
+    struct Match {
+        size_t offset;
+        size_t length;
+        int token;
+    };
+
+    SpecialTokenMatcher() = default;
+    // Empty special tokens cannot be matched and are ignored.
+    explicit SpecialTokenMatcher(const tt_stl::unordered_map<tt_stl::string, int> &special_tokens);
+
+    // The leftmost special token at or after from, the longest one if several start there. offset is
+    // std::string_view::npos when there is none.
+    [[nodiscard]] Match find(std::string_view text, size_t from = 0) const;
+    // The length of the longest suffix of text that some special token starts with, so the number of bytes at the end
+    // of text that more text could still turn into a special token.
+    [[nodiscard]] size_t partial_match_length(std::string_view text) const;
+
+private:
+    [[nodiscard]] size_t skip_to_candidate(std::string_view text, size_t from) const;
+
+    // Bytes that occur in no token share class 0, so the transition table only needs a column per distinct byte.
+    std::array<uint16_t, 256> byte_class_ {};
+    uint32_t class_count_ = 1;
+    // transitions_[state * class_count_ + class] is the complete DFA, failure links already folded in.
+    tt_stl::vector<uint32_t> transitions_ = { 0 };
+    tt_stl::vector<uint32_t> depth_ = { 0 };
+    uint32_t max_length_ = 0;
+    // The longest token that ends in each state, or length 0 if none does.
+    tt_stl::vector<uint32_t> match_length_ = { 0 };
+    tt_stl::vector<int> match_token_ = { 0 };
+    // Up to two bytes every token starts with, used to jump to the next possible match from the root state.
+    tt_stl::string prefix_;
+};
+
+}
@@ -0,0 +1,30 @@
+#include "streaming_decoder.h"
+#include "encoding_utils.h"
+
+#include <cstring>
+
+namespace tiktoken
+{
+
+void StreamingDecoder::push(std::span<const int> tokens, tt_stl::string &text)
+{
+    const BytePairEncodingCore &core = encoding_->byte_pair_encoding_core_processor_;
+    const size_t start = text.size();
+    text.resize(start + pending_size_ + core.decoded_size(tokens));
+    std::memcpy(text.data() + start, pending_, pending_size_);
+    core.decode_into(tokens, text.data() + start + pending_size_);
+
+    // The kept bytes start the new text, so a character they began is complete or still open at its end.
+    const size_t held = utf8::incomplete_suffix_length(std::string_view(text).substr(start));
+    std::memcpy(pending_, text.data() + text.size() - held, held);
+    pending_size_ = static_cast<uint8_t>(held);
+    text.resize(text.size() - held);
+}
+
+void StreamingDecoder::finish(tt_stl::string &text)
+{
+    text.append(pending_, pending_size_);
+    pending_size_ = 0;
+}
+
+}
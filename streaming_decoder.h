@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common.h"
+#include "encoding.h"
+#include <span>
+
+namespace tiktoken
+{
+
+// Decodes tokens as they are generated, handing out text only in whole UTF-8 characters. The bytes of a character
+// that later tokens still have to finish are kept back, so one decoder is a pointer and a few bytes and can be kept
+// per sequence. Everything push and finish hand out, put together, is decode of all the tokens.
+//
+// The encoding must outlive the decoder.
+class StreamingDecoder {
+public:
+    explicit StreamingDecoder(const GptEncoding &encoding) : encoding_(&encoding) { }
+
+    // Appends to text the bytes of tokens, apart from the start of a character they leave unfinished.
+    void push(std::span<const int> tokens, tt_stl::string &text);
+    void push(int token, tt_stl::string &text) { push(std::span<const int>(&token, 1), text); }
+    // The text token completes.
+    [[nodiscard]] tt_stl::string push(int token)
+    {
+        tt_stl::string text;
+        push(token, text);
+        return text;
+    }
+    // Appends the bytes still kept back, which no token finished, and makes the decoder ready for a new sequence.
+    void finish(tt_stl::string &text);
+
+    [[nodiscard]] size_t pending_size() const { return pending_size_; }
+
+private:
+    const GptEncoding *encoding_;
+    char pending_[3] = {};
+    uint8_t pending_size_ = 0;
+};
+
+}
@@ -0,0 +1,168 @@
+#include "streaming_encoder.h"
+#include "encoding_utils.h"
+#include "pretokenizer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tiktoken
+{
+
+StreamingEncoder::StreamingEncoder(const GptEncoding &encoding, tt_stl::unordered_set<tt_stl::string> allowed_special,
+    tt_stl::unordered_set<tt_stl::string> disallowed_special) :
+    encoding_(&encoding),
+    allowed_special_(std::move(allowed_special)),
+    reject_special_(disallowed_special.count("all") > 0),
+    invalid_utf8_policy_(encoding.get_invalid_utf8_policy()) { }
+
+void StreamingEncoder::push(std::string_view bytes, tt_stl::vector<int> &tokens)
+{
+    if (failed_) {
+        return;
+    }
+    pending_.append(bytes.data(), bytes.size());
+    flush(false, tokens);
+}
+
+bool StreamingEncoder::finish(tt_stl::vector<int> &tokens)
+{
+    if (!failed_) {
+        flush(true, tokens);
+    }
+    const bool accepted = !failed_;
+    pending_.clear();
+    consumed_ = 0;
+    checked_ = 0;
+    valid_from_ = 0;
+    scanned_ = 0;
+    special_scan_from_ = 0;
+    has_invalid_ = false;
+    started_ = false;
+    failed_ = false;
+    return accepted;
+}
+
+void StreamingEncoder::fail(const char *message)
+{
+    failed_ = true;
+    pending_.clear();
+    consumed_ = 0;
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+    throw std::invalid_argument(message);
+#else
+    (void) message;
+#endif
+}
+
+void StreamingEncoder::flush(bool final, tt_stl::vector<int> &tokens)
+{
+    const BytePairEncodingCore &core = encoding_->byte_pair_encoding_core_processor_;
+
+    // Check the new bytes, apart from a sequence the next push may complete
+    size_t settled = pending_size();
+    if (!final) {
+        settled -= utf8::incomplete_suffix_length(std::string_view(pending_).substr(consumed_ + checked_));
+    }
+    const std::string_view fresh = std::string_view(pending_).substr(consumed_ + checked_, settled - checked_);
+    size_t invalid = utf8::find_invalid(fresh);
+    if (invalid != std::string_view::npos) {
+        switch (invalid_utf8_policy_) {
+            case InvalidUtf8Policy::ByteFallback:
+                // The valid runs on either side of ill-formed bytes are pre-tokenized apart, so the end of the last
+                // ill-formed bytes is a cut point.
+                while (invalid != std::string_view::npos) {
+                    invalid += utf8::invalid_sequence_length(fresh.substr(invalid));
+                    valid_from_ = checked_ + invalid;
+                    const size_t next = utf8::find_invalid(fresh.substr(invalid));
+                    invalid = next == std::string_view::npos ? next : invalid + next;
+                }
+                has_invalid_ = true;
+                break;
+            case InvalidUtf8Policy::Replace: {
+                const auto replaced = utf8::replace_invalid(fresh);
+                pending_.replace(consumed_ + checked_, fresh.size(), replaced);
+                settled = checked_ + replaced.size();
+                break;
+            }
+            case InvalidUtf8Policy::Reject:
+                fail("Input is not valid UTF-8");
+                return;
+        }
+    }
+    checked_ = settled;
+
+    // Hold back what more bytes could still turn into a special token. The last special token that ends before
+    // limit is a cut point; one that runs past it moves limit back to where it starts.
+    const std::string_view text(pending_.data() + consumed_, checked_);
+    size_t limit = final ? checked_ : checked_ - core.getSpecialTokenMatcher().partial_match_length(text);
+    const auto segments = core.break_into_specials(text, allowed_special_, special_scan_from_);
+    size_t cut = 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const size_t end = offset + segments[i].size();
+        if (i % 2 == 1) {
+            if (end > limit) {
+                limit = offset;
+                break;
+            }
+            if (reject_special_) {
+                fail("Disallowed special token found");
+                return;
+            }
+            cut = end;
+        }
+        offset = end;
+    }
+
+    // Within the text after that, cut at the last point where pre-tokenization starts afresh
+    const size_t text_start = std::max(cut, valid_from_);
+    if (final) {
+        cut = limit;
+    } else if (text_start <= limit) {
+        cut = text_start;
+        const PreTokenizerPattern pattern = core.getPreTokenizer();
+        const std::string_view settled_text = text.substr(0, limit);
+        for (size_t boundary = find_pre_token_boundary(pattern, settled_text, std::max(scanned_, text_start));
+             boundary < limit; boundary = find_pre_token_boundary(pattern, settled_text, boundary)) {
+            cut = boundary;
+        }
+        // Next time, start from the last code point, as whether limit is a cut point depends on what follows it
+        scanned_ = limit;
+        if (scanned_ > cut) {
+            do {
+                --scanned_;
+            } while (scanned_ > cut && (static_cast<uint8_t>(text[scanned_]) & 0xC0) == 0x80);
+        }
+    }
+
+    // Encode the segments before cut. A leading empty special token is part of the first segments only.
+    offset = 0;
+    for (size_t i = 0; i < segments.size() && (offset < cut || final); ++i) {
+        const bool special = i % 2 == 1;
+        const size_t length = std::min(segments[i].size(), cut - offset);
+        if (!(started_ && offset == 0 && segments[i].empty())) {
+            core.encode_segment(segments[i].substr(0, length), special, allowed_special_, !has_invalid_, tokens);
+        }
+        offset += length;
+    }
+    if (cut > 0) {
+        started_ = true;
+    }
+    // Every special token that ends before limit has been cut off, and one that runs past it starts at limit
+    special_scan_from_ = limit - cut;
+    consumed_ += cut;
+    checked_ -= cut;
+    has_invalid_ = has_invalid_ && valid_from_ > cut;
+    valid_from_ = valid_from_ > cut ? valid_from_ - cut : 0;
+    scanned_ = scanned_ > cut ? scanned_ - cut : 0;
+    // Dropping the encoded bytes only once they are half the buffer moves each byte a bounded number of times
+    if (consumed_ > pending_.size() / 2) {
+        pending_.erase(0, consumed_);
+        consumed_ = 0;
+    }
+    if (!final && pending_size() > max_pending_size_) {
+        fail("Held-back text exceeds max_pending_size");
+    }
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+#include "encoding.h"
+#include <string_view>
+
+namespace tiktoken
+{
+
+// Encodes a text that arrives in pieces, such as a file read in blocks, to the same tokens encode gives for the
+// whole text. Tokens are appended to the caller's vector as soon as nothing later in the text can change them; only
+// the unfinished pre-token at the end, a possible start of a special token and a split UTF-8 sequence are held back.
+// A pattern without a hand-written pre-tokenizer has no known cut points, so with it text is only released at special
+// tokens and by finish.
+//
+// What is held back is the pre-token still open at the end of the text, which for a run of letters, digits or spaces
+// with no break is the whole run, or everything since the last special token without a pre-tokenizer. It is capped
+// at max_pending_size() bytes: a push that would leave more than that waiting fails, as no cut before it would give
+// encode's tokens. Each push only scans the bytes it adds, plus as many as the longest special token, and encoded
+// bytes are only dropped from the buffer once they are half of it, so a long hold-back does not cost repeated work.
+//
+// Input that encode rejects, any special token when disallowed_special is { "all" } or ill-formed UTF-8 under
+// InvalidUtf8Policy::Reject, is found at the push that completes it, and so is a hold-back over the cap. Tokens
+// already handed out stay with the caller; push throws, or when exceptions are disabled the encoder stops and
+// failed() turns true.
+//
+// The encoding must outlive the encoder.
+class StreamingEncoder {
+public:
+    static constexpr size_t default_max_pending_size = 16 * 1024 * 1024;
+
+    explicit StreamingEncoder(const GptEncoding &encoding, tt_stl::unordered_set<tt_stl::string> allowed_special = {},
+        tt_stl::unordered_set<tt_stl::string> disallowed_special = GptEncoding::all_special_tokens());
+
+    // Appends the next bytes of the text and then any tokens that are now final to tokens.
+    void push(std::string_view bytes, tt_stl::vector<int> &tokens);
+    // Ends the text, appending the tokens still held back, and makes the encoder ready for a new text. Returns false
+    // if the text was rejected, which when exceptions are disabled failed() no longer shows afterwards.
+    bool finish(tt_stl::vector<int> &tokens);
+
+    [[nodiscard]] bool failed() const { return failed_; }
+    // Bytes received but not encoded yet.
+    [[nodiscard]] size_t pending_size() const { return pending_.size() - consumed_; }
+    // The most bytes a push may leave held back. Takes effect at the next push.
+    void set_max_pending_size(size_t size) { max_pending_size_ = size; }
+    [[nodiscard]] size_t max_pending_size() const { return max_pending_size_; }
+
+private:
+    void flush(bool final, tt_stl::vector<int> &tokens);
+    void fail(const char *message);
+
+    const GptEncoding *encoding_;
+    tt_stl::unordered_set<tt_stl::string> allowed_special_;
+    bool reject_special_;
+    InvalidUtf8Policy invalid_utf8_policy_;
+
+    size_t max_pending_size_ = default_max_pending_size;
+
+    // The bytes from consumed_ on are waiting; the ones before it are encoded and go when they are half of pending_.
+    // The offsets below count from consumed_.
+    tt_stl::string pending_;
+    size_t consumed_ = 0;
+    // pending_ up to checked_ has been checked for ill-formed UTF-8, and repaired under InvalidUtf8Policy::Replace.
+    size_t checked_ = 0;
+    // Where the valid UTF-8 after the last ill-formed bytes in pending_ starts. Only ByteFallback keeps such bytes.
+    size_t valid_from_ = 0;
+    // Cut points have only been looked for up to the start of the code point at scanned_.
+    size_t scanned_ = 0;
+    // No special token starts in pending_ before special_scan_from_, so the search for them resumes there.
+    size_t special_scan_from_ = 0;
+    bool has_invalid_ = false;
+    // Whether tokens have been handed out for this text.
+    bool started_ = false;
+    bool failed_ = false;
+};
+
+}
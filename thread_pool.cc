@@ -0,0 +1,185 @@
+#include "thread_pool.h"
+
+#include <atomic>
+
+namespace tiktoken
+{
+
+namespace
+{
+    // The pool whose task the current thread is running, if any.
+    thread_local const ThreadPool *current_pool = nullptr;
+}
+
+struct ThreadPool::job_t {
+    const std::function<void(size_t)> *task;
+    std::atomic<size_t> remaining;
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+    std::mutex error_mutex;
+    std::exception_ptr error;
+#endif
+};
+
+ThreadPool::ThreadPool(size_t concurrency)
+{
+    if (concurrency == 0) {
+        concurrency = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < concurrency; ++i) {
+        queues_.push_back(std::make_unique<queue_t>());
+    }
+    // Queue 0 belongs to whichever thread calls run.
+    for (size_t i = 1; i < concurrency; ++i) {
+        workers_.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker: workers_) {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::run(size_t task_count, const std::function<void(size_t)> &task)
+{
+    if (task_count == 0) {
+        return;
+    }
+    if (workers_.empty() || task_count == 1 || current_pool == this) {
+        for (size_t i = 0; i < task_count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    job_t job;
+    job.task = &task;
+    job.remaining.store(task_count, std::memory_order_relaxed);
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        std::lock_guard<std::mutex> lock(queues_[i]->mutex);
+        queues_[i]->begin = task_count * i / queues_.size();
+        queues_[i]->end = task_count * (i + 1) / queues_.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        job_ = &job;
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    participate(0, job);
+
+    {
+        // Workers hold a reference to job until they leave it, so wait for them as well as for the tasks.
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        done_.wait(lock, [&] { return job.remaining.load(std::memory_order_acquire) == 0 && active_workers_ == 0; });
+        job_ = nullptr;
+    }
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+#endif
+}
+
+void ThreadPool::work(size_t self)
+{
+    uint64_t seen = 0;
+    for (;;) {
+        job_t *job;
+        {
+            std::unique_lock<std::mutex> lock(state_mutex_);
+            wake_.wait(lock, [&] { return stopping_ || (job_ != nullptr && generation_ != seen); });
+            if (stopping_) {
+                return;
+            }
+            seen = generation_;
+            job = job_;
+            ++active_workers_;
+        }
+        participate(self, *job);
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            --active_workers_;
+        }
+        done_.notify_all();
+    }
+}
+
+void ThreadPool::participate(size_t self, job_t &job)
+{
+    const ThreadPool *const outer_pool = current_pool;
+    current_pool = this;
+    size_t index;
+    while (pop(self, index) || steal(self, index)) {
+#if TIKTOKEN_EXCEPTIONS_ENABLE
+        try {
+            (*job.task)(index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.error_mutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+#else
+        (*job.task)(index);
+#endif
+        if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            done_.notify_all();
+        }
+    }
+    current_pool = outer_pool;
+}
+
+bool ThreadPool::pop(size_t self, size_t &index)
+{
+    queue_t &queue = *queues_[self];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.begin == queue.end) {
+        return false;
+    }
+    index = queue.begin++;
+    return true;
+}
+
+bool ThreadPool::steal(size_t self, size_t &index)
+{
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        queue_t &victim = *queues_[(self + offset) % queues_.size()];
+        size_t begin;
+        size_t end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end) {
+                continue;
+            }
+            // Taking the back half leaves the victim the indices next to the ones it is working through.
+            end = victim.end;
+            begin = end - (end - victim.begin + 1) / 2;
+            victim.end = begin;
+        }
+        index = begin;
+        queue_t &own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tiktoken
+{
+
+// Runs the tasks of a batch call. Implement it to run batches on threads the application already manages.
+class IExecutor {
+public:
+    virtual ~IExecutor() = default;
+    // How many tasks may run at once; batch calls split their work into a few times this many tasks.
+    [[nodiscard]] virtual size_t concurrency() const = 0;
+    // Calls task(0) to task(task_count - 1), in any order and on any threads, and returns once all have finished.
+    virtual void run(size_t task_count, const std::function<void(size_t)> &task) = 0;
+};
+
+// A fixed set of worker threads that share each run between them and the calling thread. Every thread starts on its
+// own contiguous share of the task indices and, once that is used up, steals half of what is left in another's.
+// A run made from inside one of the pool's tasks runs on the calling thread alone.
+//
+// A pool works on one run at a time. A run called while another thread's run is in progress blocks until that one
+// has finished, so concurrent batch calls on one pool queue up behind each other instead of sharing the workers, and
+// a small batch can wait for the whole of a large one. Callers that must not wait on each other need a pool each.
+class ThreadPool : public IExecutor {
+public:
+    // concurrency counts the calling thread, so concurrency - 1 workers are started. 0 means one per hardware
+    // thread.
+    explicit ThreadPool(size_t concurrency = 0);
+    ~ThreadPool() override;
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    [[nodiscard]] size_t concurrency() const override { return queues_.size(); }
+    // Waits for any run another thread has in progress on this pool before starting.
+    void run(size_t task_count, const std::function<void(size_t)> &task) override;
+
+    // The pool batch calls use when they are given no executor, started on first use.
+    static ThreadPool &shared();
+
+private:
+    // The task indices [begin, end) one thread has left.
+    struct queue_t {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+    struct job_t;
+
+    void work(size_t self);
+    void participate(size_t self, job_t &job);
+    bool pop(size_t self, size_t &index);
+    bool steal(size_t self, size_t &index);
+
+    tt_stl::vector<std::unique_ptr<queue_t>> queues_;
+    tt_stl::vector<std::thread> workers_;
+    // Held for the whole of a run, so runs from different threads take turns.
+    std::mutex run_mutex_;
+    std::mutex state_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    job_t *job_ = nullptr;
+    uint64_t generation_ = 0;
+    size_t active_workers_ = 0;
+    bool stopping_ = false;
+};
+
+}
@@ -0,0 +1,70 @@
+import os
+import sys
+import unicodedata
+
+# Generates unicode_tables.cc: the Unicode properties the hand-written pre-tokenizers need, packed into one byte per
+# code point and stored as a two-stage lookup table. Run with the Python whose unicodedata version matches the
+# Unicode version of the PCRE2 library the patterns are checked against.
+
+BLOCK_SHIFT = 7
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+
+LU, LL, LT, LM, LO, MARK, NUMBER, SPACE = (1 << bit for bit in range(8))
+
+CATEGORY_FLAGS = {
+    "Lu": LU, "Ll": LL, "Lt": LT, "Lm": LM, "Lo": LO,
+    "Mn": MARK, "Mc": MARK, "Me": MARK,
+    "Nd": NUMBER, "Nl": NUMBER, "No": NUMBER,
+}
+
+# PCRE2 with PCRE2_UCP matches \s against horizontal and vertical space plus every Z category character.
+PCRE2_HSPACE = [0x09, 0x20, 0xA0, 0x1680, 0x180E] + list(range(0x2000, 0x200B)) + [0x202F, 0x205F, 0x3000]
+PCRE2_VSPACE = list(range(0x0A, 0x0E)) + [0x85, 0x2028, 0x2029]
+
+
+def properties(code_point):
+    category = unicodedata.category(chr(code_point))
+    flags = CATEGORY_FLAGS.get(category, 0)
+    if category.startswith("Z") or code_point in PCRE2_HSPACE or code_point in PCRE2_VSPACE:
+        flags |= SPACE
+    return flags
+
+
+def format_array(values, per_line=24):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ",".join(str(v) for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main(output_file):
+    blocks = []
+    block_index = {}
+    stage1 = []
+    for block_start in range(0, 0x110000, BLOCK_SIZE):
+        block = tuple(properties(cp) for cp in range(block_start, block_start + BLOCK_SIZE))
+        if block not in block_index:
+            block_index[block] = len(blocks)
+            blocks.append(block)
+        stage1.append(block_index[block])
+
+    if len(blocks) > 256:
+        sys.exit("too many distinct blocks for an 8-bit stage 1 index")
+    stage2 = [value for block in blocks for value in block]
+
+    with open(output_file, "w", newline="\n") as cpp_file:
+        cpp_file.write(f"// Generated by tools/{os.path.basename(__file__)} from Unicode {unicodedata.unidata_version}. Do not edit.\n")
+        cpp_file.write('#include "unicode_tables.h"\n\n')
+        cpp_file.write("namespace tiktoken\n{\n\nnamespace unicode\n{\n\n")
+        cpp_file.write(f"static_assert(block_shift == {BLOCK_SHIFT});\n\n")
+        cpp_file.write(f'const char version[] = "{unicodedata.unidata_version}";\n\n')
+        cpp_file.write(f"const uint8_t block_index[{len(stage1)}] = {{\n{format_array(stage1)}\n}};\n\n")
+        cpp_file.write(f"const uint8_t block_properties[{len(stage2)}] = {{\n{format_array(stage2)}\n}};\n\n")
+        cpp_file.write("}\n\n}\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: python gen_unicode_tables.py <output_file>")
+        sys.exit(1)
+    main(sys.argv[1])
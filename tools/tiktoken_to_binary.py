@@ -0,0 +1,104 @@
+import base64
+import struct
+import sys
+
+# Converts a .tiktoken vocabulary into the binary format BinaryVocabulary maps (see binary_vocabulary.h). The hash
+# and the slot layout must stay identical to rank_table.h, because the index is written here and searched as is.
+
+MAGIC = b"TTKVOCAB"
+VERSION = 2
+MASK64 = (1 << 64) - 1
+
+
+def rank_table_hash(data):
+    multiplier = 0x9E3779B97F4A7C15
+
+    def mix(h, word):
+        h = ((h ^ word) * multiplier) & MASK64
+        return h ^ (h >> 32)
+
+    h = (len(data) * 0xFF51AFD7ED558CCD) & MASK64
+    offset = 0
+    while offset + 8 <= len(data):
+        h = mix(h, int.from_bytes(data[offset:offset + 8], "little"))
+        offset += 8
+    if offset < len(data):
+        h = mix(h, int.from_bytes(data[offset:], "little"))
+    h ^= h >> 29
+    h = (h * 0xBF58476D1CE4E5B9) & MASK64
+    return h ^ (h >> 32)
+
+
+def slot_count_for(token_count):
+    return token_count + token_count // 3 + 1
+
+
+def home_slot(h, slot_count):
+    return ((h & 0xFFFFFFFF) * slot_count) >> 32
+
+
+def align8(data):
+    return data + b"\0" * (-len(data) % 8)
+
+
+def read_tiktoken(input_file):
+    ranks = {}
+    with open(input_file, "rb") as f:
+        for line in f:
+            fields = line.split()
+            if fields:
+                ranks[int(fields[1])] = base64.b64decode(fields[0])
+    return ranks
+
+
+def build(ranks, special_tokens):
+    token_count = max(ranks) + 1 if ranks else 0
+    slot_count = slot_count_for(token_count)
+    if token_count >= (1 << 24) - 1:
+        sys.exit("too many tokens for the 24-bit rank of a slot")
+    slots = [0] * slot_count
+    offsets = []
+    blob = bytearray()
+    for rank in range(token_count):
+        offsets.append(len(blob))
+        if rank not in ranks:
+            continue
+        blob += ranks[rank]
+        h = rank_table_hash(ranks[rank])
+        index = home_slot(h, slot_count)
+        while slots[index] != 0:
+            index = index + 1 if index + 1 < slot_count else 0
+        slots[index] = (h >> 56) << 24 | (rank + 1)
+    offsets.append(len(blob))
+
+    header_size = 64
+    offsets_section = align8(struct.pack(f"<{len(offsets)}I", *offsets))
+    slots_section = struct.pack(f"<{slot_count}I", *slots)
+    blob_section = bytes(blob)
+    specials_section = b"".join(struct.pack("<II", token_id, len(token)) + token
+                                for token, token_id in sorted(special_tokens, key=lambda entry: entry[1]))
+
+    offsets_offset = header_size
+    slots_offset = offsets_offset + len(offsets_section)
+    bytes_offset = slots_offset + len(slots_section)
+    # Slots are 4 bytes wide, so the blob may end off an 8-byte boundary even though it started on one.
+    blob_section += bytes(-(bytes_offset + len(blob_section)) % 8)
+    specials_offset = bytes_offset + len(blob_section)
+    file_size = specials_offset + len(specials_section)
+    header = MAGIC + struct.pack("<IIII5Q", VERSION, token_count, slot_count, len(special_tokens),
+                                 offsets_offset, slots_offset, bytes_offset, specials_offset, file_size)
+    return header + offsets_section + slots_section + blob_section + specials_section
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: python tiktoken_to_binary.py <input.tiktoken> <output_file> [<special_token> <id>]...")
+        sys.exit(1)
+
+    arguments = sys.argv[3:]
+    if len(arguments) % 2 != 0:
+        sys.exit("special tokens are given as pairs of token and id")
+    special_tokens = [(arguments[i].encode("utf-8"), int(arguments[i + 1])) for i in range(0, len(arguments), 2)]
+
+    with open(sys.argv[2], "wb") as output:
+        output.write(build(read_tiktoken(sys.argv[1]), special_tokens))
@@ -0,0 +1,46 @@
+import os
+import sys
+
+from tiktoken_to_binary import build, read_tiktoken
+
+# Compiles a .tiktoken vocabulary into a C++ source file holding its binary image (see binary_vocabulary.h), so an
+# embedded encoding is used in place without any decoding at runtime. The image is written as string literals, which
+# compilers handle much faster than a list of numbers; MSVC caps the length of a string literal, so it gets an array
+# of 64-bit words instead.
+
+SAFE_CHARACTERS = frozenset(range(0x20, 0x7F)) - {ord('"'), ord("\\"), ord("?")}
+
+
+def string_literals(image, bytes_per_line=96):
+    lines = []
+    for i in range(0, len(image), bytes_per_line):
+        chunk = image[i:i + bytes_per_line]
+        lines.append('    "' + "".join(chr(b) if b in SAFE_CHARACTERS else f"\\{b:03o}" for b in chunk) + '"')
+    return "\n".join(lines)
+
+
+def word_array(image, words_per_line=8):
+    padded = image + b"\0" * (-len(image) % 8)
+    words = [f"0x{int.from_bytes(padded[i:i + 8], 'little'):x}ull" for i in range(0, len(padded), 8)]
+    return "\n".join("    " + ", ".join(words[i:i + words_per_line]) + "," for i in range(0, len(words), words_per_line))
+
+
+def main(input_file, output_file, name, output_format):
+    image = build(read_tiktoken(input_file), [])
+
+    with open(output_file, "w", newline="\n") as cpp_file:
+        cpp_file.write(f"// Generated by tools/{os.path.basename(__file__)} from {os.path.basename(input_file)}. Do not edit.\n")
+        cpp_file.write("#include <cstddef>\n#include <cstdint>\n#include <utility>\n\n")
+        if output_format == "array":
+            cpp_file.write(f"alignas(8) static const uint64_t {name}[] = {{\n{word_array(image)}\n}};\n\n")
+        else:
+            cpp_file.write(f"alignas(8) static const char {name}[] =\n{string_literals(image)};\n\n")
+        cpp_file.write(f"std::pair<const unsigned char *, size_t> get_{name}()\n{{\n")
+        cpp_file.write(f"    return {{ reinterpret_cast<const unsigned char *>({name}), {len(image)} }};\n}}\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4:
+        print("Usage: python vocab2cpp.py <input.tiktoken> <output_file> <name> [string|array]")
+        sys.exit(1)
+    main(sys.argv[1], sys.argv[2], sys.argv[3], sys.argv[4] if len(sys.argv) > 4 else "string")
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+namespace tiktoken
+{
+
+namespace unicode
+{
+
+// Properties of a code point, as used by the pre-tokenizer patterns. Letter categories are kept apart because the
+// o200k pattern distinguishes them; marks and numbers cover all of their sub-categories; space is what PCRE2 matches
+// with \s when PCRE2_UCP is set.
+enum : uint8_t {
+    Lu = 1 << 0,
+    Ll = 1 << 1,
+    Lt = 1 << 2,
+    Lm = 1 << 3,
+    Lo = 1 << 4,
+    Mark = 1 << 5,
+    Number = 1 << 6,
+    Space = 1 << 7,
+
+    Letter = Lu | Ll | Lt | Lm | Lo
+};
+
+constexpr int block_shift = 7;
+
+// Generated by tools/gen_unicode_tables.py.
+// The Unicode version the tables come from. It has to be the one PCRE2 reports as PCRE2_CONFIG_UNICODE_VERSION,
+// or the hand-written pre-tokenizers stop matching the regexes on code points the two versions disagree about.
+extern const char version[];
+extern const uint8_t block_index[0x110000 >> block_shift];
+extern const uint8_t block_properties[];
+
+inline uint8_t properties(uint32_t code_point)
+{
+    if (code_point >= 0x110000) {
+        return 0;
+    }
+    const uint32_t block = block_index[code_point >> block_shift];
+    return block_properties[(block << block_shift) | (code_point & ((1u << block_shift) - 1))];
+}
+
+}
+
+}
@@ -1,9 +1,29 @@
 #include "encoding.h"
+#include "binary_vocabulary.h"
 #include "embedded_resource_reader.h"
+#include "encoding_registry.h"
+#include "encoding_utils.h"
+#include "modelparams.h"
+#include "pcre2_regex.h"
+#include "piece_cache.h"
+#include "pretokenizer.h"
+#include "scratch_memory.h"
+#include "special_token_matcher.h"
+#include "streaming_decoder.h"
+#include "streaming_encoder.h"
+#include "thread_pool.h"
+#include "unicode_tables.h"
 
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <random>
+#include <thread>
+
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
 
 class TFilePathResourceReader : public tiktoken::IResourceReader {
 public:
@@ -54,6 +74,930 @@ TEST(TestGetEncoding, TestCustomResourceReader)
     ASSERT_EQ(tokens[1], 1917);
 }
 
+TEST(TestGetEncoding, TestDecode_O200K_BASE)
+{
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    const tiktoken::tt_stl::string text = "hello world, 你好世界! <|endoftext|>";
+    tiktoken::tt_stl::vector<int> tokens = encoder.encode(text, { "<|endoftext|>" }, {});
+    ASSERT_EQ(tokens.back(), 199999);
+    ASSERT_EQ(encoder.decoded_size(tokens), text.size());
+    ASSERT_EQ(encoder.decode(tokens), text);
+    ASSERT_EQ(encoder.decode({ 24912, -1, 2375, 1000000 }), "hello world");
+}
+
+TEST(TestGetEncoding, TestInvalidUtf8)
+{
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const tiktoken::tt_stl::string text = "hello \xE4\xBD world\xFF\xC0\xAF!";
+
+    ASSERT_EQ(encoder.get_invalid_utf8_policy(), tiktoken::InvalidUtf8Policy::ByteFallback);
+    tiktoken::tt_stl::vector<int> tokens = encoder.encode(text);
+    ASSERT_FALSE(tokens.empty());
+    ASSERT_EQ(encoder.decode(tokens), text);
+
+    encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::Replace);
+    ASSERT_EQ(encoder.encode(text), encoder.encode("hello \xEF\xBF\xBD world\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD!"));
+
+    encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::Reject);
+    ASSERT_TRUE(encoder.encode(text).empty());
+    ASSERT_EQ(encoder.encode("hello world").size(), 2);
+}
+
+TEST(TestGetEncoding, TestCountTokens)
+{
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    const tiktoken::tt_stl::string texts[] = { "", "hello world", "hello world, 你好世界! <|endoftext|> \xFF\xFE",
+        "The quick brown fox jumps over the lazy dog. It's 2024, and we've got 1234567 reasons." };
+    for (const auto &text: texts) {
+        ASSERT_EQ(encoder.count_tokens(text, { "<|endoftext|>" }, {}), encoder.encode(text, { "<|endoftext|>" }, {}).size());
+        ASSERT_EQ(encoder.count_tokens(text, {}, {}), encoder.encode(text, {}, {}).size());
+    }
+    ASSERT_EQ(encoder.count_tokens("hello <|endoftext|>"), 0);
+
+    encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::Replace);
+    ASSERT_EQ(encoder.count_tokens(texts[2], {}, {}), encoder.encode(texts[2], {}, {}).size());
+    encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::Reject);
+    ASSERT_EQ(encoder.count_tokens(texts[2], {}, {}), 0);
+}
+
+TEST(TestGetEncoding, TestPreTokenizerMatchesRegex)
+{
+    // Code points from every class the bundled patterns distinguish, plus the contraction letters.
+    const char *const alphabet[] = { "a", "Z", "s", "t", "r", "e", "v", "m", "l", "d", "7", " ", " ", "\n", "\r", "\t",
+        "'", "/", ".", "\xC5\xBF", "\xC3\xA9", "\xC3\x89", "\xC7\x85", "\xCA\xB0", "\xCC\x81", "\xD7\x90",
+        "\xD9\xA0", "\xE2\x85\xA0", "\xC2\xA0", "\xC2\x85", "\xE2\x80\xA8", "\xE3\x80\x80", "\xE4\xBD\xA0",
+        "\xF0\x9F\x8E\x89" };
+    std::mt19937 random(42);
+    for (const auto model: { tiktoken::LanguageModel::O200K_BASE, tiktoken::LanguageModel::CL100K_BASE,
+             tiktoken::LanguageModel::P50K_BASE }) {
+        const char *const pattern = tiktoken::ModelParamsGenerator::get_pattern(model);
+        const auto pre_tokenizer = tiktoken::find_pre_tokenizer_pattern(pattern);
+        ASSERT_NE(pre_tokenizer, tiktoken::PreTokenizerPattern::None);
+        const tiktoken::PCRERegex regex(pattern, PCRE2_CASELESS);
+        for (int i = 0; i < 20000; ++i) {
+            tiktoken::tt_stl::string text;
+            for (size_t length = 1 + random() % 16; length > 0; --length) {
+                text += alphabet[random() % std::size(alphabet)];
+            }
+            tiktoken::tt_stl::vector<std::pair<size_t, size_t>> pieces;
+            tiktoken::for_each_pre_token(pre_tokenizer, text, [&pieces](size_t offset, size_t length) {
+                pieces.emplace_back(offset, length);
+            });
+            ASSERT_EQ(pieces, regex.all_matches(text)) << text;
+        }
+    }
+    ASSERT_EQ(tiktoken::find_pre_tokenizer_pattern("\\s+"), tiktoken::PreTokenizerPattern::None);
+}
+
+TEST(TestGetEncoding, TestUnicodeTablesMatchPcre2)
+{
+    char pcre2_version[24] = {};
+    ASSERT_GT(pcre2_config_8(PCRE2_CONFIG_UNICODE_VERSION, pcre2_version), 0);
+    ASSERT_STREQ(pcre2_version, tiktoken::unicode::version);
+}
+
+TEST(TestGetEncoding, TestPreTokenizerMatchesRegexOnVocabularies)
+{
+    // The vocabularies were learned from multilingual text, so their tokens, run together, reach far more code points
+    // than the alphabet above.
+    for (const auto model: { tiktoken::LanguageModel::O200K_BASE, tiktoken::LanguageModel::CL100K_BASE,
+             tiktoken::LanguageModel::P50K_BASE }) {
+        const auto params = tiktoken::ModelParamsGenerator::get_model_params(model);
+        const auto pre_tokenizer = tiktoken::find_pre_tokenizer_pattern(params.pat_str);
+        ASSERT_NE(pre_tokenizer, tiktoken::PreTokenizerPattern::None);
+        const tiktoken::PCRERegex regex(params.pat_str, PCRE2_CASELESS);
+        const auto &ranks = params.mergeable_ranks;
+        for (uint32_t first = 0; first < ranks.token_count(); first += 8) {
+            tiktoken::tt_stl::string tokens;
+            for (uint32_t rank = first; rank < std::min(first + 8, ranks.token_count()); ++rank) {
+                const auto bytes = ranks.bytes(static_cast<int>(rank));
+                tokens.append(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+            }
+            const auto text = tiktoken::utf8::replace_invalid(tokens);
+            tiktoken::tt_stl::vector<std::pair<size_t, size_t>> pieces;
+            tiktoken::for_each_pre_token(pre_tokenizer, text, [&pieces](size_t offset, size_t length) {
+                pieces.emplace_back(offset, length);
+            });
+            ASSERT_EQ(pieces, regex.all_matches(text)) << text;
+        }
+    }
+}
+
+TEST(TestGetEncoding, TestPreTokenBoundary)
+{
+    const char *const alphabet[] = { "a", "Z", "s", "t", "7", " ", " ", "\n", "\r", "\t", "'", "/", ".", "\xC3\xA9",
+        "\xC3\x89", "\xC7\x85", "\xCA\xB0", "\xCC\x81", "\xD9\xA0", "\xE2\x85\xA0", "\xC2\xA0", "\xC2\x85",
+        "\xE3\x80\x80", "\xE4\xBD\xA0", "\xF0\x9F\x8E\x89" };
+    const auto pre_tokenize = [](tiktoken::PreTokenizerPattern pattern, std::string_view text, size_t shift,
+                                  tiktoken::tt_stl::vector<std::pair<size_t, size_t>> &pieces) {
+        tiktoken::for_each_pre_token(pattern, text, [&](size_t offset, size_t length) {
+            pieces.emplace_back(offset + shift, length);
+        });
+    };
+    std::mt19937 random(7);
+    size_t cuts = 0;
+    for (const auto pattern: { tiktoken::PreTokenizerPattern::O200K, tiktoken::PreTokenizerPattern::CL100K,
+             tiktoken::PreTokenizerPattern::P50K }) {
+        for (int i = 0; i < 5000; ++i) {
+            tiktoken::tt_stl::string text;
+            for (size_t length = 1 + random() % 24; length > 0; --length) {
+                text += alphabet[random() % std::size(alphabet)];
+            }
+            tiktoken::tt_stl::vector<std::pair<size_t, size_t>> whole;
+            pre_tokenize(pattern, text, 0, whole);
+            for (size_t from = 0;; ++from) {
+                const size_t cut = tiktoken::find_pre_token_boundary(pattern, text, from);
+                ASSERT_GE(cut, std::max<size_t>(from, 1));
+                if (cut >= text.size()) {
+                    break;
+                }
+                tiktoken::tt_stl::vector<std::pair<size_t, size_t>> halves;
+                pre_tokenize(pattern, std::string_view(text).substr(0, cut), 0, halves);
+                pre_tokenize(pattern, std::string_view(text).substr(cut), cut, halves);
+                ASSERT_EQ(halves, whole) << text << " cut at " << cut;
+                ++cuts;
+                from = cut;
+            }
+        }
+    }
+    ASSERT_GT(cuts, 10000);
+    ASSERT_EQ(tiktoken::find_pre_token_boundary(tiktoken::PreTokenizerPattern::None, "a b", 0), 3);
+}
+
+TEST(TestGetEncoding, TestSpecialTokenMatcher)
+{
+    const tiktoken::SpecialTokenMatcher matcher({ { "<|a|>", 1 }, { "<|ab|>", 2 }, { "b|><|a", 3 }, { "<|abc|>", 4 } });
+    const std::string_view text = "x<|ab|><|a|> <|abc|><|a";
+    tiktoken::tt_stl::vector<std::pair<size_t, int>> matches;
+    for (auto match = matcher.find(text); match.offset != std::string_view::npos;
+         match = matcher.find(text, match.offset + match.length)) {
+        matches.emplace_back(match.offset, match.token);
+        ASSERT_GT(match.length, 0);
+    }
+    ASSERT_EQ(matches, (tiktoken::tt_stl::vector<std::pair<size_t, int>> { { 1, 2 }, { 7, 1 }, { 13, 4 } }));
+    ASSERT_EQ(tiktoken::SpecialTokenMatcher().find(text).offset, std::string_view::npos);
+
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    ASSERT_TRUE(encoder.encode("hello <|endoftext|>").empty());
+    ASSERT_EQ(encoder.encode("hello <|endoftext|><|endofprompt|>", { "<|endoftext|>", "<|endofprompt|>" }, {}),
+        (tiktoken::tt_stl::vector<int> { 15339, 220, 100257, 100276 }));
+}
+
+TEST(TestGetEncoding, TestConcurrentEncodeDecode)
+{
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    const tiktoken::tt_stl::vector<tiktoken::tt_stl::string> texts = { "hello world, 你好世界! <|endoftext|>",
+        "The quick brown fox jumps over the lazy dog. It's 2024, and we've got 1234567 reasons.",
+        "int main() {\n    return 0;\n}\n", "Ünïcödé wörds 🎉 and \xFF invalid bytes" };
+    tiktoken::tt_stl::vector<tiktoken::tt_stl::vector<int>> expected;
+    for (const auto &text: texts) {
+        expected.push_back(encoder.encode(text, { "<|endoftext|>" }, {}));
+    }
+
+    const unsigned thread_count = std::max(4u, std::thread::hardware_concurrency());
+    tiktoken::tt_stl::vector<int> failures(thread_count, 0);
+    tiktoken::tt_stl::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < 500; ++i) {
+                const size_t index = (i + t) % texts.size();
+                const auto tokens = encoder.encode(texts[index], { "<|endoftext|>" }, {});
+                if (tokens != expected[index] || encoder.decode(tokens) != texts[index]) {
+                    ++failures[t];
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_EQ(std::count(failures.begin(), failures.end(), 0), thread_count);
+}
+
+TEST(TestGetEncoding, TestEncodeBatch)
+{
+    // Runs every task on the calling thread, in reverse, to check that nothing depends on the pool's order.
+    class ReverseExecutor : public tiktoken::IExecutor {
+    public:
+        size_t concurrency() const override { return 3; }
+        void run(size_t task_count, const std::function<void(size_t)> &task) override
+        {
+            for (size_t i = task_count; i > 0; --i) {
+                task(i - 1);
+            }
+        }
+    };
+
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    tiktoken::tt_stl::vector<tiktoken::tt_stl::string> documents = { "", "hello world", "hello <|endoftext|>",
+        "Ünïcödé wörds 🎉 and \xFF invalid bytes", "int main() {\n    return 0;\n}\n" };
+    for (int i = 0; i < 200; ++i) {
+        documents.push_back("document " + tiktoken::tt_stl::to_string(i) + tiktoken::tt_stl::string(i % 37, 'x'));
+    }
+    const tiktoken::tt_stl::vector<std::string_view> texts(documents.begin(), documents.end());
+
+    tiktoken::ThreadPool pool(4);
+    ReverseExecutor reverse;
+    for (tiktoken::IExecutor *executor: { static_cast<tiktoken::IExecutor *>(&pool), static_cast<tiktoken::IExecutor *>(&reverse),
+             static_cast<tiktoken::IExecutor *>(nullptr) }) {
+        const auto batch = encoder.encode_batch(texts, {}, tiktoken::GptEncoding::all_special_tokens(), executor);
+        ASSERT_EQ(batch.size(), documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            const auto expected = encoder.encode(documents[i]);
+            ASSERT_EQ(tiktoken::tt_stl::vector<int>(batch[i].begin(), batch[i].end()), expected) << i;
+        }
+        // The rejected document has no tokens, so it decodes to nothing.
+        const auto decoded = encoder.decode_batch(batch, executor);
+        ASSERT_EQ(decoded.size(), documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            ASSERT_EQ(decoded[i], i == 2 ? "" : documents[i]) << i;
+        }
+    }
+
+    ASSERT_EQ(encoder.encode_batch({}).size(), 0);
+    const tiktoken::tt_stl::vector<size_t> bad_offsets = { 0, 5, 3 };
+    ASSERT_EQ(encoder.decode_batch(std::span<const int>(), bad_offsets).size(), 0);
+
+    std::atomic<size_t> sum { 0 };
+    pool.run(1000, [&](size_t i) {
+        pool.run(3, [&](size_t j) { sum += i * 3 + j; });
+    });
+    ASSERT_EQ(sum.load(), 3000 * 2999 / 2);
+
+    // Runs from several threads take turns on the pool, and each still gets all of its tasks
+    std::atomic<size_t> total { 0 };
+    tiktoken::tt_stl::vector<std::thread> callers;
+    for (int t = 0; t < 4; ++t) {
+        callers.emplace_back([&] { pool.run(500, [&](size_t i) { total += i; }); });
+    }
+    for (auto &caller: callers) {
+        caller.join();
+    }
+    ASSERT_EQ(total.load(), 4 * (500 * 499 / 2));
+}
+
+TEST(TestGetEncoding, TestEncodeParallel)
+{
+    const tiktoken::tt_stl::string words[] = { "The", " quick", " brown", " fox", " jumps", " over", " the", " lazy",
+        " dog", ".", "\n\n", "   ", " It's", " we've", " 1234567", " Ünïcödé", " wörds", ", ", "你好世界", " 🎉",
+        " {\"key\": [1, 2, 3]}", "\t", "CamelCase" };
+    std::mt19937 random(11);
+    tiktoken::tt_stl::string text;
+    while (text.size() < 600 * 1024) {
+        text += words[random() % std::size(words)];
+    }
+    // One long run with no safe cut in it, which has to stay whole, and a few special tokens between long texts.
+    text.insert(text.size() / 2, tiktoken::tt_stl::string(100 * 1024, 'x'));
+    text.insert(text.size() / 3, "<|endoftext|>");
+    text.insert(text.size() / 5, "<|endofprompt|><|endoftext|>");
+
+    tiktoken::ThreadPool pool(4);
+    for (const auto model: { tiktoken::LanguageModel::O200K_BASE, tiktoken::LanguageModel::CL100K_BASE,
+             tiktoken::LanguageModel::P50K_BASE }) {
+        auto encoder = tiktoken::GptEncoding::get_encoding(model);
+        const tiktoken::tt_stl::unordered_set<tiktoken::tt_stl::string> allowed = { "<|endoftext|>" };
+        ASSERT_EQ(encoder.encode_parallel(text, allowed, {}, &pool), encoder.encode(text, allowed, {}));
+        ASSERT_EQ(encoder.encode_parallel(text, {}, {}, &pool), encoder.encode(text, {}, {}));
+        ASSERT_TRUE(encoder.encode_parallel(text, {}, tiktoken::GptEncoding::all_special_tokens(), &pool).empty());
+
+        const tiktoken::tt_stl::string invalid = text + "\xFF" + text.substr(0, 1000);
+        ASSERT_EQ(encoder.encode_parallel(invalid, {}, {}, &pool), encoder.encode(invalid, {}, {}));
+        encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::Replace);
+        ASSERT_EQ(encoder.encode_parallel(invalid, {}, {}, &pool), encoder.encode(invalid, {}, {}));
+    }
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    ASSERT_EQ(encoder.encode_parallel("hello world"), encoder.encode("hello world"));
+}
+
+TEST(TestGetEncoding, TestStreamingEncoder)
+{
+    const char *const pieces[] = { "The", " quick", " fox", "'s", " 1234567", " \xC3\xBCn\xC3\xAF", "\xE4\xBD\xA0\xE5\xA5\xBD",
+        " \xF0\x9F\x8E\x89", ".", "\n\n", "   ", "\t", "CamelCase", "\xCC\x81", "<|endoftext|>", "<|endofprompt|>",
+        "<|", "endoftext", "|>", "<|endo", "\xFF", "\xE4\xBD", "\xED\xA0\x80" };
+    std::mt19937 random(5);
+    for (const auto model: { tiktoken::LanguageModel::O200K_BASE, tiktoken::LanguageModel::CL100K_BASE,
+             tiktoken::LanguageModel::P50K_BASE }) {
+        auto encoder = tiktoken::GptEncoding::get_encoding(model);
+        const tiktoken::tt_stl::unordered_set<tiktoken::tt_stl::string> allowed = { "<|endoftext|>" };
+        for (const auto policy: { tiktoken::InvalidUtf8Policy::ByteFallback, tiktoken::InvalidUtf8Policy::Replace }) {
+            encoder.set_invalid_utf8_policy(policy);
+            tiktoken::StreamingEncoder stream(encoder, allowed, {});
+            for (int i = 0; i < 300; ++i) {
+                tiktoken::tt_stl::string text;
+                for (size_t length = random() % 60; length > 0; --length) {
+                    text += pieces[random() % std::size(pieces)];
+                }
+                // Chunks of one byte, of a few bytes and of the whole text
+                const size_t chunk_size = i % 3 == 0 ? 1 : i % 3 == 1 ? 1 + random() % 9 : text.size() + 1;
+                tiktoken::tt_stl::vector<int> tokens;
+                for (size_t offset = 0; offset < text.size(); offset += chunk_size) {
+                    stream.push(std::string_view(text).substr(offset, chunk_size), tokens);
+                }
+                stream.finish(tokens);
+                ASSERT_EQ(tokens, encoder.encode(text, allowed, {})) << text;
+            }
+        }
+    }
+
+    // Ordinary text is released as it arrives, so the held-back bytes stay within about one block.
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    tiktoken::tt_stl::string text;
+    while (text.size() < 1024 * 1024) {
+        text += pieces[random() % 14];
+    }
+    tiktoken::StreamingEncoder stream(encoder);
+    tiktoken::tt_stl::vector<int> tokens;
+    size_t most_pending = 0;
+    for (size_t offset = 0; offset < text.size(); offset += 4096) {
+        stream.push(std::string_view(text).substr(offset, 4096), tokens);
+        most_pending = std::max(most_pending, stream.pending_size());
+    }
+    stream.finish(tokens);
+    ASSERT_EQ(tokens, encoder.encode(text));
+    ASSERT_LT(most_pending, 256);
+
+    // A run with no cut point is held back whole, and each push only scans what it adds
+    const tiktoken::tt_stl::string run = "x" + tiktoken::tt_stl::string(256 * 1024, 'a') + "<|endoftext|> b";
+    tiktoken::StreamingEncoder run_stream(encoder, { "<|endoftext|>" }, {});
+    tokens.clear();
+    for (size_t offset = 0; offset < run.size(); offset += 16) {
+        run_stream.push(std::string_view(run).substr(offset, 16), tokens);
+    }
+    ASSERT_TRUE(run_stream.finish(tokens));
+    ASSERT_EQ(tokens, encoder.encode(run, { "<|endoftext|>" }, {}));
+
+    // Past the cap, the run is rejected rather than held back
+    run_stream.set_max_pending_size(64 * 1024);
+    tokens.clear();
+    for (size_t offset = 0; offset < run.size() && !run_stream.failed(); offset += 16) {
+        run_stream.push(std::string_view(run).substr(offset, 16), tokens);
+        ASSERT_LE(run_stream.pending_size(), 64 * 1024);
+    }
+    ASSERT_TRUE(run_stream.failed());
+    ASSERT_FALSE(run_stream.finish(tokens));
+
+    stream.push("hello <|endoftext|> world", tokens);
+    ASSERT_TRUE(stream.failed());
+    stream.finish(tokens);
+    ASSERT_FALSE(stream.failed());
+}
+
+TEST(TestGetEncoding, TestStreamingDecoder)
+{
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const tiktoken::tt_stl::string text = "Ünïcödé wörds, 你好世界, 🎉🎊 and 𝔘𝔫𝔦𝔠𝔬𝔡𝔢 text.";
+    const auto tokens = encoder.encode(text);
+
+    tiktoken::StreamingDecoder decoder(encoder);
+    tiktoken::tt_stl::string decoded;
+    size_t held_back = 0;
+    for (const int token: tokens) {
+        const auto piece = decoder.push(token);
+        ASSERT_EQ(tiktoken::utf8::find_invalid(piece), std::string_view::npos);
+        held_back += decoder.pending_size() > 0 ? 1 : 0;
+        decoded += piece;
+    }
+    decoder.finish(decoded);
+    ASSERT_EQ(decoded, text);
+    ASSERT_GT(held_back, 0);
+
+    // A character no token finishes comes out as its bytes at the end, as decode gives it.
+    const auto truncated = encoder.encode("\xF0\x9F\x8E");
+    tiktoken::tt_stl::string out;
+    decoder.push(truncated, out);
+    ASSERT_TRUE(out.empty());
+    decoder.finish(out);
+    ASSERT_EQ(out, encoder.decode(truncated));
+    ASSERT_EQ(decoder.pending_size(), 0);
+}
+
+TEST(TestGetEncoding, TestPieceCache)
+{
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const tiktoken::tt_stl::string words[] = { " the", " tokenization", " antidisestablishmentarianism", " 1234567",
+        " Ünïcödé", " 你好世界", " 🎉🎊", " supercalifragilisticexpialidocious-ish", "\n\n", " xyzzyplugh" };
+    std::mt19937 random(3);
+    tiktoken::tt_stl::vector<tiktoken::tt_stl::string> texts;
+    tiktoken::tt_stl::vector<tiktoken::tt_stl::vector<int>> expected;
+    for (int i = 0; i < 200; ++i) {
+        tiktoken::tt_stl::string text;
+        for (int j = 0; j < 50; ++j) {
+            text += words[random() % std::size(words)];
+        }
+        expected.push_back(encoder.encode(text));
+        texts.push_back(std::move(text));
+    }
+    ASSERT_EQ(encoder.piece_cache_stats().capacity, 0);
+
+    // A small cache, so that pieces evict each other, read by several threads at once
+    encoder.set_piece_cache_capacity(6);
+    ASSERT_EQ(encoder.piece_cache_stats().capacity, 4);
+    tiktoken::tt_stl::vector<std::thread> threads;
+    std::atomic<int> failures { 0 };
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (size_t i = 0; i < texts.size(); ++i) {
+                if (encoder.encode(texts[i]) != expected[i] || encoder.count_tokens(texts[i]) != expected[i].size()) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_EQ(failures.load(), 0);
+    const auto stats = encoder.piece_cache_stats();
+    ASSERT_GT(stats.hits, 0);
+    ASSERT_GT(stats.misses, 0);
+
+    encoder.set_piece_cache_capacity(0);
+    ASSERT_EQ(encoder.piece_cache_stats().hits, 0);
+    ASSERT_EQ(encoder.encode(texts[0]), expected[0]);
+}
+
+TEST(TestGetEncoding, TestPieceCacheEntryLimits)
+{
+    using tiktoken::PieceCache;
+    PieceCache cache(1);
+    const tiktoken::tt_stl::vector<uint8_t> bytes(PieceCache::max_piece_size + 1, 'a');
+    const tiktoken::tt_stl::vector<int> many(PieceCache::max_cached_tokens + 1, 7);
+    int tokens[PieceCache::max_cached_tokens];
+
+    // The longest piece fits with one token, a longer one does not
+    const std::span<const uint8_t> longest(bytes.data(), PieceCache::max_piece_size);
+    cache.insert(longest, 1, std::span<const int>(many.data(), 1));
+    ASSERT_EQ(cache.find(longest, 1, tokens), 1);
+    cache.insert(bytes, 2, std::span<const int>(many.data(), 1));
+    ASSERT_EQ(cache.find(bytes, 2, tokens), 0);
+
+    // A two byte piece fits max_cached_tokens tokens, and no more
+    const std::span<const uint8_t> pair(bytes.data(), 2);
+    cache.insert(pair, 3, std::span<const int>(many.data(), PieceCache::max_cached_tokens));
+    ASSERT_EQ(cache.find(pair, 3, tokens), PieceCache::max_cached_tokens);
+    ASSERT_EQ(tokens[PieceCache::max_cached_tokens - 1], 7);
+    cache.insert(pair, 4, many);
+    ASSERT_EQ(cache.find(pair, 4, tokens), 0);
+}
+
+TEST(TestGetEncoding, TestEncodeIntoBuffers)
+{
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::P50K_BASE);
+    tiktoken::tt_stl::string text;
+    for (int i = 0; i < 100; ++i) {
+        text += "The quick brown fox jumps over the lazy dog. Ünïcödé wörds, 你好世界 🎉 <|endoftext|>\n";
+    }
+    const tiktoken::tt_stl::unordered_set<tiktoken::tt_stl::string> allowed = { "<|endoftext|>" };
+    const auto expected = encoder.encode(text, allowed, {});
+    ASSERT_EQ(encoder.max_token_value(), 50280);
+
+    // Appending to a reused container, past the 256-token blocks the encoder hands out
+    tiktoken::tt_stl::vector<uint16_t> narrow = { 7 };
+    encoder.encode_into(text, narrow, allowed, {});
+    ASSERT_EQ(narrow.size(), expected.size() + 1);
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(), narrow.begin() + 1));
+    tiktoken::tt_stl::vector<uint32_t> wide;
+    encoder.encode_into(text, wide, allowed, {});
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(), wide.begin(), wide.end()));
+
+    tiktoken::tt_stl::vector<uint16_t> buffer(expected.size());
+    auto result = encoder.encode_into(text, std::span<uint16_t>(buffer), allowed, {});
+    ASSERT_EQ(result.size, expected.size());
+    ASSERT_FALSE(result.overflow);
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(), buffer.begin(), buffer.end()));
+    std::fill(buffer.begin(), buffer.end(), 0);
+    std::span<uint16_t> short_span(buffer.data(), 300);
+    result = encoder.encode_into(text, short_span, allowed, {});
+    ASSERT_EQ(result.size, expected.size());
+    ASSERT_TRUE(result.overflow);
+    ASSERT_TRUE(std::equal(expected.begin(), expected.begin() + 300, buffer.begin()));
+    ASSERT_EQ(buffer[300], 0);
+    ASSERT_EQ(encoder.encode_into(text, std::span<uint16_t>(buffer)).size, 0);
+
+    tiktoken::tt_stl::string decoded = "> ";
+    encoder.decode_into(std::span<const uint16_t>(narrow).subspan(1), decoded);
+    ASSERT_EQ(decoded, "> " + text);
+    tiktoken::tt_stl::string bytes(100, '\0');
+    const auto decode_result = encoder.decode_into(std::span<const uint32_t>(wide), std::span<char>(bytes));
+    ASSERT_EQ(decode_result.size, text.size());
+    ASSERT_TRUE(decode_result.overflow);
+    ASSERT_EQ(bytes, text.substr(0, 100));
+    const int64_t out_of_range[] = { 464, int64_t(1) << 32 | 464, -1 };
+    decoded.clear();
+    encoder.decode_into(std::span<const int64_t>(out_of_range), decoded);
+    ASSERT_EQ(decoded, encoder.decode({ 464 }));
+    const uint32_t unsigned_out_of_range[] = { 464, uint32_t(1) << 31 | 464 };
+    decoded.clear();
+    encoder.decode_into(std::span<const uint32_t>(unsigned_out_of_range), decoded);
+    ASSERT_EQ(decoded, encoder.decode({ 464 }));
+
+    // cl100k ids do not fit 16 bits
+    const auto wide_encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    tiktoken::tt_stl::vector<uint16_t> rejected;
+    wide_encoder.encode_into("hello world", rejected);
+    ASSERT_TRUE(rejected.empty());
+    wide_encoder.encode_into("hello world", wide);
+    ASSERT_EQ(wide.size(), expected.size() + 2);
+}
+
+TEST(TestGetEncoding, TestScratchMemory)
+{
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        size_t allocations = 0;
+
+    private:
+        void *do_allocate(size_t bytes, size_t alignment) override
+        {
+            ++allocations;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        void do_deallocate(void *pointer, size_t bytes, size_t alignment) override
+        {
+            std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+    };
+
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::O200K_BASE);
+    encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::Replace);
+    const tiktoken::tt_stl::string text = "hello <|endoftext|> world \xFF and more";
+    const tiktoken::tt_stl::unordered_set<tiktoken::tt_stl::string> allowed = { "<|endoftext|>" };
+    const auto expected = encoder.encode(text, allowed, {});
+
+    CountingResource outer;
+    std::pmr::monotonic_buffer_resource arena(4096, &outer);
+    CountingResource inner;
+    {
+        tiktoken::ScratchMemoryScope scope(&arena);
+        ASSERT_EQ(tiktoken::scratch_memory_resource(), &arena);
+        {
+            tiktoken::ScratchMemoryScope nested(&inner);
+            ASSERT_EQ(encoder.count_tokens(text, allowed, {}), expected.size());
+            ASSERT_GT(inner.allocations, 0);
+        }
+        ASSERT_EQ(tiktoken::scratch_memory_resource(), &arena);
+
+        std::pmr::vector<int> tokens(&arena);
+        encoder.encode_into(text, tokens, allowed, {});
+        ASSERT_TRUE(std::equal(expected.begin(), expected.end(), tokens.begin(), tokens.end()));
+        std::pmr::string decoded(&arena);
+        encoder.decode_into(std::span<const int>(tokens), decoded);
+        ASSERT_EQ(std::string_view(decoded), encoder.decode(expected));
+        ASSERT_EQ(encoder.encode(text, allowed, {}), expected);
+    }
+    ASSERT_EQ(tiktoken::scratch_memory_resource(), std::pmr::get_default_resource());
+    ASSERT_EQ(outer.allocations, 1);
+}
+
+TEST(TestGetEncoding, TestEncodePrefix)
+{
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const char *const pieces[] = { "The", " quick", " fox", "'s", " 1234567", " \xC3\xBCn\xC3\xAF", "\xE4\xBD\xA0\xE5\xA5\xBD",
+        " \xF0\x9F\x8E\x89", ".", "\n\n", "   ", "CamelCase", "<|endoftext|>", "\xFF", "\xE4\xBD" };
+    const tiktoken::tt_stl::unordered_set<tiktoken::tt_stl::string> allowed = { "<|endoftext|>" };
+    std::mt19937 random(9);
+    for (const auto policy: { tiktoken::InvalidUtf8Policy::ByteFallback, tiktoken::InvalidUtf8Policy::Replace }) {
+        encoder.set_invalid_utf8_policy(policy);
+        for (int i = 0; i < 200; ++i) {
+            tiktoken::tt_stl::string text;
+            for (size_t length = random() % 400; length > 0; --length) {
+                text += pieces[random() % std::size(pieces)];
+            }
+            const auto all = encoder.encode(text, allowed, {});
+            const size_t budget = random() % (all.size() + 8);
+            const auto prefix = encoder.encode_prefix(text, budget, allowed, {});
+            const size_t expected = std::min(budget, all.size());
+            ASSERT_EQ(prefix.tokens, tiktoken::tt_stl::vector<int>(all.begin(), all.begin() + expected)) << text;
+            // The offset is where the text the tokens stand for ends
+            const auto decoded = encoder.decode(prefix.tokens);
+            if (policy == tiktoken::InvalidUtf8Policy::ByteFallback) {
+                ASSERT_EQ(decoded, text.substr(0, prefix.offset)) << text;
+            } else if (tiktoken::utf8::find_invalid(decoded) == std::string_view::npos) {
+                ASSERT_EQ(decoded, tiktoken::utf8::replace_invalid(text.substr(0, prefix.offset))) << text;
+            }
+            ASSERT_EQ(encoder.fits_within(text, budget, allowed, {}), all.size() <= budget);
+        }
+    }
+    encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::ByteFallback);
+
+    // A large text costs no more than its first blocks
+    tiktoken::tt_stl::string text;
+    while (text.size() < 2 * 1024 * 1024) {
+        text += pieces[random() % 12];
+    }
+    const auto prefix = encoder.encode_prefix(text, 100);
+    ASSERT_EQ(prefix.tokens.size(), 100);
+    ASSERT_EQ(encoder.decode(prefix.tokens), text.substr(0, prefix.offset));
+    ASSERT_FALSE(encoder.fits_within(text, 100));
+    ASSERT_TRUE(encoder.fits_within("hello world", 2));
+    ASSERT_FALSE(encoder.fits_within("hello world", 1));
+
+    // Only the part that was encoded is checked for disallowed special tokens
+    ASSERT_EQ(encoder.encode_prefix("hello world <|endoftext|>", 1).tokens, encoder.encode("hello"));
+    ASSERT_TRUE(encoder.encode_prefix("hello <|endoftext|> world", 3).tokens.empty());
+}
+
+TEST(TestGetEncoding, TestEncodeWithOffsets)
+{
+    const char *const pieces[] = { "The", " quick", " fox", "'s", " 1234567", " \xC3\xBCn\xC3\xAF", "\xE4\xBD\xA0\xE5\xA5\xBD",
+        " \xF0\x9F\x8E\x89", ".", "\n\n", "   ", "CamelCase", "<|endoftext|>", "\xFF", "\xE4\xBD", "\xED\xA0\x80" };
+    const tiktoken::tt_stl::unordered_set<tiktoken::tt_stl::string> allowed = { "<|endoftext|>" };
+    std::mt19937 random(11);
+    tiktoken::tt_stl::vector<int> tokens;
+    tiktoken::tt_stl::vector<tiktoken::ByteRange> offsets;
+    for (const auto model: { tiktoken::LanguageModel::O200K_BASE, tiktoken::LanguageModel::R50K_BASE }) {
+        auto encoder = tiktoken::GptEncoding::get_encoding(model);
+        encoder.set_piece_cache_capacity(1024);
+        for (const auto policy: { tiktoken::InvalidUtf8Policy::ByteFallback, tiktoken::InvalidUtf8Policy::Replace }) {
+            encoder.set_invalid_utf8_policy(policy);
+            for (int i = 0; i < 200; ++i) {
+                tiktoken::tt_stl::string text;
+                for (size_t length = random() % 60; length > 0; --length) {
+                    text += pieces[random() % std::size(pieces)];
+                }
+                encoder.encode_with_offsets(text, tokens, offsets, allowed, {});
+                ASSERT_EQ(tokens, encoder.encode(text, allowed, {})) << text;
+                ASSERT_EQ(offsets.size(), tokens.size());
+                // The ranges cover the text in order, each token standing for its own bytes
+                size_t covered = 0;
+                for (size_t t = 0; t < tokens.size(); ++t) {
+                    const auto bytes = std::string_view(text).substr(offsets[t].start, offsets[t].end - offsets[t].start);
+                    if (policy == tiktoken::InvalidUtf8Policy::ByteFallback) {
+                        ASSERT_EQ(offsets[t].start, covered) << text;
+                        ASSERT_EQ(encoder.decode({ tokens[t] }), bytes) << text;
+                    } else {
+                        ASSERT_LE(offsets[t].start, covered) << text;
+                        ASSERT_GE(offsets[t].end, covered) << text;
+                        if (tiktoken::utf8::find_invalid(bytes) == std::string_view::npos) {
+                            ASSERT_EQ(encoder.decode({ tokens[t] }), bytes) << text;
+                        }
+                    }
+                    covered = offsets[t].end;
+                }
+                ASSERT_EQ(covered, text.size()) << text;
+            }
+        }
+    }
+
+    auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    encoder.encode_with_offsets("hello <|endoftext|>", tokens, offsets, allowed, {});
+    ASSERT_EQ(offsets, (tiktoken::tt_stl::vector<tiktoken::ByteRange> { { 0, 5 }, { 5, 6 }, { 6, 19 } }));
+    encoder.set_invalid_utf8_policy(tiktoken::InvalidUtf8Policy::Replace);
+    encoder.encode_with_offsets("a\xFF\xFE" "b", tokens, offsets);
+    ASSERT_EQ(encoder.decode(tokens), "a\xEF\xBF\xBD\xEF\xBF\xBD" "b");
+    ASSERT_EQ(offsets.back().end, 4);
+    encoder.encode_with_offsets("hello <|endoftext|>", tokens, offsets);
+    ASSERT_TRUE(tokens.empty());
+    ASSERT_TRUE(offsets.empty());
+}
+
+TEST(TestGetEncoding, TestEncodeStats)
+{
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const tiktoken::tt_stl::string text = "Hello world, antidisestablishmentarianism!\n\n  \xFF 12345";
+    tiktoken::GptEncoding::reset_stats();
+    const auto tokens = encoder.encode(text);
+    // Threads count on their own and are summed when stats are read, also after the thread has exited
+    std::thread([&encoder, &text] { encoder.encode(text); }).join();
+    const auto stats = tiktoken::GptEncoding::stats();
+    if (!tiktoken::EncodeStats::enabled) {
+        ASSERT_EQ(stats.bytes_in, 0);
+        ASSERT_EQ(stats.tokens, 0);
+        return;
+    }
+    ASSERT_EQ(stats.bytes_in, 2 * text.size());
+    ASSERT_EQ(stats.tokens, 2 * tokens.size());
+    uint64_t pieces = 0;
+    for (const auto count: stats.piece_lengths) {
+        pieces += count;
+    }
+    ASSERT_EQ(pieces, stats.pieces);
+    ASSERT_GT(stats.pieces, 0);
+    ASSERT_LE(stats.pieces, stats.tokens);
+    ASSERT_GT(stats.merge_iterations, 0);
+    ASSERT_GT(stats.nanoseconds(tiktoken::EncodeStage::Utf8Validation), 0);
+    ASSERT_GT(stats.nanoseconds(tiktoken::EncodeStage::PreTokenize) + stats.nanoseconds(tiktoken::EncodeStage::Merge), 0);
+
+    tiktoken::GptEncoding::reset_stats();
+    ASSERT_EQ(tiktoken::GptEncoding::stats().tokens, 0);
+    const auto counted = encoder.count_tokens("hello world");
+    ASSERT_EQ(tiktoken::GptEncoding::stats().tokens, counted);
+}
+
+TEST(TestGetEncoding, TestEncodingRegistry)
+{
+    tiktoken::EncodingRegistry::warm_up({ tiktoken::LanguageModel::CL100K_BASE });
+
+    tiktoken::tt_stl::vector<std::shared_ptr<const tiktoken::GptEncoding>> encoders(8);
+    tiktoken::tt_stl::vector<std::thread> threads;
+    for (auto &encoder: encoders) {
+        threads.emplace_back([&encoder] { encoder = tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::O200K_BASE); });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_NE(encoders[0], nullptr);
+    ASSERT_EQ(std::count(encoders.begin(), encoders.end(), encoders[0]), encoders.size());
+    ASSERT_EQ(encoders[0]->encode("hello world"), (tiktoken::tt_stl::vector<int> { 24912, 2375 }));
+
+    const auto cl100k = tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::CL100K_BASE);
+    ASSERT_EQ(cl100k, tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::CL100K_BASE));
+    ASSERT_NE(cl100k, encoders[0]);
+
+    TFilePathResourceReader reader;
+    const auto llama3 = tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::CL100K_BASE, &reader,
+        "tokenizer_llama3.1.model", tiktoken::EncodingVariant::Llama3);
+    const auto llama3_1 = tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::CL100K_BASE, &reader,
+        "tokenizer_llama3.1.model", tiktoken::EncodingVariant::Llama3_1);
+    ASSERT_NE(llama3, llama3_1);
+    ASSERT_EQ(llama3->encode("<|eot_id|>", { "<|eot_id|>" }, {}), (tiktoken::tt_stl::vector<int> { 128009 }));
+    ASSERT_EQ(llama3_1->encode("<|python_tag|>", { "<|python_tag|>" }, {}), (tiktoken::tt_stl::vector<int> { 128010 }));
+}
+
+TEST(TestGetEncoding, TestEncodingRegistryRetriesFailedLoad)
+{
+    // Fails the first read, as a file that is not there yet would
+    class FlakyReader : public TFilePathResourceReader {
+    public:
+        int reads = 0;
+        tiktoken::tt_stl::vector<tiktoken::tt_stl::string> readLines(std::string_view resourceName) override
+        {
+            return reads++ == 0 ? tiktoken::tt_stl::vector<tiktoken::tt_stl::string> {}
+                                : TFilePathResourceReader::readLines(resourceName);
+        }
+    };
+    FlakyReader reader;
+    ASSERT_EQ(tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::CL100K_BASE, &reader, "cl100k_base.tiktoken"), nullptr);
+    const auto encoder = tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::CL100K_BASE, &reader, "cl100k_base.tiktoken");
+    ASSERT_NE(encoder, nullptr);
+    ASSERT_EQ(encoder->encode("hello world"), (tiktoken::tt_stl::vector<int> { 15339, 1917 }));
+    ASSERT_EQ(encoder, tiktoken::EncodingRegistry::get(tiktoken::LanguageModel::CL100K_BASE, &reader, "cl100k_base.tiktoken"));
+    ASSERT_EQ(reader.reads, 2);
+}
+
+TEST(TestGetEncoding, TestRankTableBuilder)
+{
+    const auto bytes = [](const char *text) {
+        return std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(text), std::strlen(text));
+    };
+    tiktoken::RankTable::Builder builder;
+    builder.add(bytes("ccc"), 3);
+    builder.add(bytes("a"), 0);
+    builder.add(bytes("a"), 1);
+    builder.add(bytes("dd"), 0);
+    builder.add(bytes("ee"), -1);
+    const auto ranks = builder.build();
+    ASSERT_EQ(ranks.token_count(), 4);
+    ASSERT_EQ(ranks.find(bytes("a")), 0);
+    ASSERT_EQ(ranks.find(bytes("ccc")), 3);
+    ASSERT_EQ(ranks.find(bytes("dd")), -1);
+    ASSERT_EQ(ranks.find(bytes("ee")), -1);
+    ASSERT_TRUE(ranks.bytes(1).empty());
+    ASSERT_TRUE(ranks.bytes(2).empty());
+    ASSERT_EQ(ranks.byte_size(), 4);
+    ASSERT_EQ(builder.build().token_count(), 0);
+
+    // Appending keeps the first of two equal entries across builders too
+    tiktoken::RankTable::Builder first;
+    tiktoken::RankTable::Builder second;
+    first.add(bytes("a"), 0);
+    second.add(bytes("a"), 1);
+    second.add(bytes("bb"), 2);
+    first.append(std::move(second));
+    ASSERT_EQ(second.size(), 0);
+    const auto appended = first.build();
+    ASSERT_EQ(appended.find(bytes("a")), 0);
+    ASSERT_EQ(appended.find(bytes("bb")), 2);
+
+    // Hashing on an executor lays the index out exactly as a serial build does
+    const auto encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const tiktoken::RankTable serial(encoder.get_byte_pair_token_map());
+    tiktoken::RankTable::Builder large;
+    for (uint32_t rank = 0; rank < serial.token_count(); ++rank) {
+        large.add(serial.bytes(static_cast<int>(rank)), static_cast<int>(rank));
+    }
+    tiktoken::ThreadPool pool(4);
+    const auto parallel = large.build(&pool);
+    ASSERT_EQ(parallel.slot_count(), serial.slot_count());
+    ASSERT_EQ(std::memcmp(parallel.slots(), serial.slots(), serial.slot_count() * sizeof(tiktoken::RankTable::Slot)), 0);
+    ASSERT_EQ(parallel.byte_size(), serial.byte_size());
+}
+
+TEST(TestGetEncoding, TestBase64Decode)
+{
+    const auto decode = [](std::string_view text) {
+        const auto bytes = tiktoken::base64::decode(text);
+        return tiktoken::tt_stl::string(bytes.begin(), bytes.end());
+    };
+    ASSERT_EQ(decode(""), "");
+    ASSERT_EQ(decode("aGVsbG8="), "hello");
+    ASSERT_EQ(decode("aGVsbG8"), "hello");
+    ASSERT_EQ(decode("aGVsbA=="), "hell");
+    ASSERT_EQ(decode("aGVsbGwh"), "helll!");
+    ASSERT_EQ(decode("IA=="), " ");
+    ASSERT_EQ(decode("+/8="), "\xFB\xFF");
+    // Decoding stops at the first character outside the alphabet
+    ASSERT_EQ(decode("aGVs bG8="), "hel");
+
+    tiktoken::tt_stl::string all_bytes;
+    for (int byte = 0; byte < 256; ++byte) {
+        all_bytes.push_back(static_cast<char>(byte));
+    }
+    const tiktoken::tt_stl::string encoded = "AAECAwQFBgcICQoLDA0ODxAREhMUFRYXGBkaGxwdHh8gISIjJCUmJygpKissLS4vMDEyMzQ1Njc4OT"
+        "o7PD0+P0BBQkNERUZHSElKS0xNTk9QUVJTVFVWV1hZWltcXV5fYGFiY2RlZmdoaWprbG1ub3BxcnN0dXZ3eHl6e3x9fn+AgYKDhIWGh4iJiouMjY"
+        "6PkJGSk5SVlpeYmZqbnJ2en6ChoqOkpaanqKmqq6ytrq+wsbKztLW2t7i5uru8vb6/wMHCw8TFxsfIycrLzM3Oz9DR0tPU1dbX2Nna29zd3t/g4e"
+        "Lj5OXm5+jp6uvs7e7v8PHy8/T19vf4+fr7/P3+/w==";
+    ASSERT_EQ(decode(encoded), all_bytes);
+    ASSERT_LE(tiktoken::base64::decode(encoded).size(), tiktoken::base64::decoded_size_bound(encoded.size()));
+}
+
+TEST(TestGetEncoding, TestLoaderMapMatchesRankTable)
+{
+    TFilePathResourceReader reader;
+    tiktoken::EmbeddedResourceLoader loader("p50k_base.tiktoken", &reader);
+    const tiktoken::bpe_encoding_t map = loader.loadTokenBytePairEncoding();
+    const tiktoken::RankTable table = loader.loadRankTable();
+    // p50k leaves a rank unused, where its end of text token goes
+    size_t used = 0;
+    for (uint32_t rank = 0; rank < table.token_count(); ++rank) {
+        used += table.bytes(static_cast<int>(rank)).empty() ? 0 : 1;
+    }
+    ASSERT_EQ(map.size(), used);
+    for (const auto &[bytes, rank]: map) {
+        ASSERT_EQ(table.find(bytes), rank);
+    }
+}
+
+TEST(TestGetEncoding, TestSpecialTokenDecode)
+{
+    const auto text = [](std::span<const uint8_t> bytes) { return tiktoken::tt_stl::string(bytes.begin(), bytes.end()); };
+    tiktoken::bpe_encoding_t ranks = { { { 'a' }, 0 }, { { 'b' }, 1 }, { { 'a', 'b' }, 2 } };
+    // The map form of the ranks is still accepted
+    tiktoken::ModelParams params(0, "\\S+", std::move(ranks), { { "<s>", 5 }, { "<e>", 7 }, { "<o>", 1 } });
+    ASSERT_EQ(params.mergeable_ranks.token_count(), 3);
+    ASSERT_EQ(params.mergeable_ranks_map().size(), 3);
+
+    const tiktoken::BytePairEncodingCore core(std::move(params.mergeable_ranks), std::move(params.special_tokens),
+        tiktoken::PCRERegex(params.pat_str));
+    ASSERT_EQ(text(core.token_bytes(2)), "ab");
+    ASSERT_EQ(text(core.token_bytes(5)), "<s>");
+    ASSERT_EQ(text(core.token_bytes(7)), "<e>");
+    // A special token decodes before the rank that shares its id
+    ASSERT_EQ(text(core.token_bytes(1)), "<o>");
+    ASSERT_TRUE(core.token_bytes(6).empty());
+    ASSERT_TRUE(core.token_bytes(8).empty());
+    ASSERT_TRUE(core.token_bytes(-1).empty());
+    ASSERT_EQ(core.max_token_id(), 7);
+    ASSERT_EQ(core.decode_native(std::vector<int> { 2, 5, 0, 6, 7 }), "ab<s>a<e>");
+}
+
+TEST(TestGetEncoding, TestBinaryVocabulary)
+{
+    const auto text_encoder = tiktoken::GptEncoding::get_encoding(tiktoken::LanguageModel::CL100K_BASE);
+    const tiktoken::RankTable ranks(text_encoder.get_byte_pair_token_map());
+    ASSERT_EQ(ranks.find(std::span<const uint8_t>(reinterpret_cast<const uint8_t *>("hello"), 5)), 15339);
+    ASSERT_EQ(ranks.find(std::span<const uint8_t>(reinterpret_cast<const uint8_t *>("\xFF\xFF\xFF"), 3)), -1);
+
+    const tiktoken::tt_stl::string path = "cl100k_base.test.bin";
+    ASSERT_TRUE(tiktoken::BinaryVocabulary::write_file(path, ranks, {}));
+    const auto binary_encoder = tiktoken::GptEncoding::get_encoding_from_binary(tiktoken::LanguageModel::CL100K_BASE, path);
+    const tiktoken::tt_stl::string text = "hello world, 你好世界! <|endoftext|> \xFF\xFE";
+    const auto tokens = binary_encoder.encode(text, { "<|endoftext|>" }, {});
+    ASSERT_EQ(tokens, text_encoder.encode(text, { "<|endoftext|>" }, {}));
+    ASSERT_EQ(binary_encoder.decode(tokens), text);
+
+    ASSERT_TRUE(tiktoken::BinaryVocabulary::write_file(path, ranks, { { "<|custom|>", 100300 } }));
+    const auto custom_encoder = tiktoken::GptEncoding::get_encoding_from_binary(tiktoken::LanguageModel::CL100K_BASE, path);
+    ASSERT_EQ(custom_encoder.encode("<|custom|>", { "<|custom|>" }, {}), (tiktoken::tt_stl::vector<int> { 100300 }));
+    ASSERT_EQ(custom_encoder.encode("<|endoftext|>", { "<|endoftext|>" }, {}).size(), 7);
+    ASSERT_EQ(tiktoken::GptEncoding::get_encoding_from_binary(tiktoken::LanguageModel::COUNT, path).max_token_value(), -1);
+
+    // Byte offsets that run past the end of the image are caught with or without the index check
+    std::ifstream written(path, std::ios::binary | std::ios::ate);
+    tiktoken::tt_stl::vector<uint64_t> words((static_cast<size_t>(written.tellg()) + 7) / 8);
+    const size_t image_size = static_cast<size_t>(written.tellg());
+    written.seekg(0);
+    written.read(reinterpret_cast<char *>(words.data()), static_cast<std::streamsize>(image_size));
+    written.close();
+    const std::span<uint8_t> image(reinterpret_cast<uint8_t *>(words.data()), image_size);
+    ASSERT_EQ(tiktoken::BinaryVocabulary::from_image(image, nullptr).ranks.token_count(), ranks.token_count());
+    tiktoken::BinaryVocabularyHeader header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    const uint32_t past_end = static_cast<uint32_t>(image_size - header.bytes_offset + 1);
+    std::memcpy(image.data() + header.offsets_offset + header.token_count * sizeof(uint32_t), &past_end, sizeof(past_end));
+    ASSERT_EQ(tiktoken::BinaryVocabulary::from_image(image, nullptr).ranks.token_count(), 0);
+    ASSERT_EQ(tiktoken::BinaryVocabulary::from_image(image, nullptr, true).ranks.token_count(), 0);
+
+    {
+        std::ofstream truncated(path, std::ios::binary | std::ios::trunc);
+        truncated.write(tiktoken::BinaryVocabulary::Magic, sizeof(tiktoken::BinaryVocabulary::Magic));
+    }
+    ASSERT_EQ(tiktoken::BinaryVocabulary::map_file(path).ranks.token_count(), 0);
+    ASSERT_EQ(tiktoken::BinaryVocabulary::map_file("missing.bin").ranks.token_count(), 0);
+    std::remove(path.c_str());
+}
+
 // Test cases below are inspired by meta-llama3 https://github.com/meta-llama/llama3/blob/main/llama/test_tokenizer.py
 
 TEST(TestGetEncoding, TestLLama3Tokenizer)